@@ -0,0 +1,130 @@
+#include "activation.h"
+#include "cpufeatures.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef HAVE_AVX2_KERNELS
+namespace activationavx2 {
+void sigmoid(const double* z, double bias, double* p, size_t count);
+void logSigmoid(const double* z, double* out, size_t count);
+double logisticLoss(const double* z, double bias, const double* y, size_t count);
+}
+#endif
+
+#ifdef HAVE_AVX512_KERNELS
+namespace activationavx512 {
+void sigmoid(const double* z, double bias, double* p, size_t count);
+void logSigmoid(const double* z, double* out, size_t count);
+double logisticLoss(const double* z, double bias, const double* y, size_t count);
+}
+#endif
+
+namespace {
+
+void scalarSigmoid(const double* z, double bias, double* p, size_t count) {
+    // Same branches as the SIMD kernels, so e^x never overflows
+    for (size_t i = 0; i < count; ++i) {
+        double x = z[i] + bias;
+        double e = std::exp(-std::abs(x));
+        double s = 1.0 / (1.0 + e);
+        p[i] = x < 0 ? e * s : s;
+    }
+}
+
+void scalarLogSigmoid(const double* z, double* out, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = std::min(z[i], 0.0) - std::log1p(std::exp(-std::abs(z[i])));
+    }
+}
+
+double scalarLogisticLoss(const double* z, double bias, const double* y, size_t count) {
+    // -y*log(sigmoid(x)) - (1-y)*log(1-sigmoid(x)) = log(1 + e^x) - y*x, written so it cannot overflow or take log(0)
+    double total = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        double x = z[i] + bias;
+        total += std::max(x, 0.0) - y[i] * x + std::log1p(std::exp(-std::abs(x)));
+    }
+    return total;
+}
+
+struct Kernels {
+    ActivationKernel kernel;
+    void (*sigmoid)(const double*, double, double*, size_t);
+    void (*logSigmoid)(const double*, double*, size_t);
+    double (*logisticLoss)(const double*, double, const double*, size_t);
+};
+
+bool cpuSupports(ActivationKernel kernel) {
+    switch (kernel) {
+    case ActivationKernel::Avx2: return cpuHasAvx2Fma();
+    case ActivationKernel::Avx512: return cpuHasAvx512f();
+    default: return true;
+    }
+}
+
+bool kernelsFor(ActivationKernel kernel, Kernels& kernels) {
+    if (!cpuSupports(kernel)) {
+        return false;
+    }
+    switch (kernel) {
+    case ActivationKernel::Scalar:
+        kernels = {kernel, scalarSigmoid, scalarLogSigmoid, scalarLogisticLoss};
+        return true;
+#ifdef HAVE_AVX2_KERNELS
+    case ActivationKernel::Avx2:
+        kernels = {kernel, activationavx2::sigmoid, activationavx2::logSigmoid, activationavx2::logisticLoss};
+        return true;
+#endif
+#ifdef HAVE_AVX512_KERNELS
+    case ActivationKernel::Avx512:
+        kernels = {kernel, activationavx512::sigmoid, activationavx512::logSigmoid, activationavx512::logisticLoss};
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+Kernels& active() {
+    // Widest kernel the CPU and the build both have, chosen on first use
+    static Kernels kernels = []() {
+        Kernels best;
+        for (ActivationKernel kernel : {ActivationKernel::Avx512, ActivationKernel::Avx2, ActivationKernel::Scalar}) {
+            if (kernelsFor(kernel, best)) {
+                break;
+            }
+        }
+        return best;
+    }();
+    return kernels;
+}
+
+}
+
+void sigmoid(const double* z, double bias, double* p, size_t count) {
+    active().sigmoid(z, bias, p, count);
+}
+
+void logSigmoid(const double* z, double* out, size_t count) {
+    active().logSigmoid(z, out, count);
+}
+
+double logisticLoss(const double* z, double bias, const double* y, size_t count) {
+    return active().logisticLoss(z, bias, y, count);
+}
+
+ActivationKernel activationKernel() {
+    return active().kernel;
+}
+
+const char* activationKernelName(ActivationKernel kernel) {
+    switch (kernel) {
+    case ActivationKernel::Avx2: return "avx2";
+    case ActivationKernel::Avx512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+bool setActivationKernel(ActivationKernel kernel) {
+    return kernelsFor(kernel, active());
+}
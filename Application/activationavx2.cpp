@@ -0,0 +1,51 @@
+// Built with AVX2 and FMA enabled (see CMakeLists.txt); only called once activation.cpp has checked the CPU
+#include "activationsimd.h"
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2 {
+    using Register = __m256d;
+    using Mask = __m256d;
+    static constexpr size_t width = 4;
+
+    static Register load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, Register a) { _mm256_storeu_pd(p, a); }
+    static Register set1(double a) { return _mm256_set1_pd(a); }
+    static Register add(Register a, Register b) { return _mm256_add_pd(a, b); }
+    static Register sub(Register a, Register b) { return _mm256_sub_pd(a, b); }
+    static Register mul(Register a, Register b) { return _mm256_mul_pd(a, b); }
+    static Register div(Register a, Register b) { return _mm256_div_pd(a, b); }
+    static Register fma(Register a, Register b, Register c) { return _mm256_fmadd_pd(a, b, c); }
+    static Register min(Register a, Register b) { return _mm256_min_pd(a, b); }
+    static Register max(Register a, Register b) { return _mm256_max_pd(a, b); }
+    static Register abs(Register a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+    static Register bitsToScale(Register shifted) {
+        __m256i biased = _mm256_add_epi64(_mm256_castpd_si256(shifted), _mm256_set1_epi64x(1023));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(biased, 52));
+    }
+    static Mask lessThan(Register a, Register b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+    static Register select(Mask mask, Register a, Register b) { return _mm256_blendv_pd(b, a, mask); }
+    static double sum(Register a) {
+        __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+        return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+    }
+};
+
+}
+
+namespace activationavx2 {
+
+void sigmoid(const double* z, double bias, double* p, size_t count) {
+    activationsimd::sigmoid<Avx2>(z, bias, p, count);
+}
+
+void logSigmoid(const double* z, double* out, size_t count) {
+    activationsimd::logSigmoid<Avx2>(z, out, count);
+}
+
+double logisticLoss(const double* z, double bias, const double* y, size_t count) {
+    return activationsimd::logisticLoss<Avx2>(z, bias, y, count);
+}
+
+}
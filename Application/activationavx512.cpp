@@ -0,0 +1,59 @@
+// Built with AVX-512F enabled (see CMakeLists.txt); only called once activation.cpp has checked the CPU
+#include "activationsimd.h"
+
+// GCC's AVX-512 intrinsics pass an undefined register as the unused merge source of their masked builtins,
+// which its own uninitialized-use analysis then reports from inside the header
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+struct Avx512 {
+    using Register = __m512d;
+    using Mask = __mmask8;
+    static constexpr size_t width = 8;
+
+    static Register load(const double* p) { return _mm512_loadu_pd(p); }
+    static void store(double* p, Register a) { _mm512_storeu_pd(p, a); }
+    static Register set1(double a) { return _mm512_set1_pd(a); }
+    static Register add(Register a, Register b) { return _mm512_add_pd(a, b); }
+    static Register sub(Register a, Register b) { return _mm512_sub_pd(a, b); }
+    static Register mul(Register a, Register b) { return _mm512_mul_pd(a, b); }
+    static Register div(Register a, Register b) { return _mm512_div_pd(a, b); }
+    static Register fma(Register a, Register b, Register c) { return _mm512_fmadd_pd(a, b, c); }
+    static Register min(Register a, Register b) { return _mm512_min_pd(a, b); }
+    static Register max(Register a, Register b) { return _mm512_max_pd(a, b); }
+    static Register abs(Register a) { return _mm512_abs_pd(a); }
+    static Register bitsToScale(Register shifted) {
+        __m512i biased = _mm512_add_epi64(_mm512_castpd_si512(shifted), _mm512_set1_epi64(1023));
+        return _mm512_castsi512_pd(_mm512_slli_epi64(biased, 52));
+    }
+    static Mask lessThan(Register a, Register b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+    static Register select(Mask mask, Register a, Register b) { return _mm512_mask_blend_pd(mask, b, a); }
+    static double sum(Register a) { return _mm512_reduce_add_pd(a); }
+};
+
+}
+
+namespace activationavx512 {
+
+void sigmoid(const double* z, double bias, double* p, size_t count) {
+    activationsimd::sigmoid<Avx512>(z, bias, p, count);
+}
+
+void logSigmoid(const double* z, double* out, size_t count) {
+    activationsimd::logSigmoid<Avx512>(z, out, count);
+}
+
+double logisticLoss(const double* z, double bias, const double* y, size_t count) {
+    return activationsimd::logisticLoss<Avx512>(z, bias, y, count);
+}
+
+}
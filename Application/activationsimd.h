@@ -0,0 +1,169 @@
+#ifndef ACTIVATIONSIMD_H
+#define ACTIVATIONSIMD_H
+
+// Kernel bodies shared by activationavx2.cpp and activationavx512.cpp. Each of those is compiled with its
+// own instruction set flags and instantiates the templates below with a struct V wrapping its intrinsics:
+//   V::Register, V::Mask, V::width, load, store, set1, add, sub, mul, div, fma (a * b + c), min, max, abs,
+//   bitsToScale (2^n from the low bits of n + 0x1.8p52), lessThan, select (mask ? a : b), sum.
+// Only include this from a translation unit built for that instruction set.
+
+#include <cstddef>
+
+#define EXP_ARGUMENT_LIMIT 708.0 // e^-708 is still a normal double
+
+namespace activationsimd {
+
+// e^-a for a in [0, EXP_ARGUMENT_LIMIT]: a = n ln2 - r with |r| <= ln2 / 2, e^-r by its degree 13 Taylor polynomial
+template <typename V>
+inline typename V::Register negativeExp(typename V::Register a) {
+    using R = typename V::Register;
+    const R x = V::sub(V::set1(0.0), a);
+    // Adding 1.5 * 2^52 rounds to an integer, which then sits in the low bits of the sum
+    const R shifted = V::fma(x, V::set1(1.4426950408889634), V::set1(0x1.8p52));
+    const R n = V::sub(shifted, V::set1(0x1.8p52));
+    // Cody-Waite: n * ln2High is exact for |n| < 2^11
+    R r = V::fma(n, V::set1(-6.93147180369123816490e-01), x);
+    r = V::fma(n, V::set1(-1.90821492927058770002e-10), r);
+
+    R p = V::set1(1.0 / 6227020800.0);
+    p = V::fma(p, r, V::set1(1.0 / 479001600.0));
+    p = V::fma(p, r, V::set1(1.0 / 39916800.0));
+    p = V::fma(p, r, V::set1(1.0 / 3628800.0));
+    p = V::fma(p, r, V::set1(1.0 / 362880.0));
+    p = V::fma(p, r, V::set1(1.0 / 40320.0));
+    p = V::fma(p, r, V::set1(1.0 / 5040.0));
+    p = V::fma(p, r, V::set1(1.0 / 720.0));
+    p = V::fma(p, r, V::set1(1.0 / 120.0));
+    p = V::fma(p, r, V::set1(1.0 / 24.0));
+    p = V::fma(p, r, V::set1(1.0 / 6.0));
+    p = V::fma(p, r, V::set1(0.5));
+    p = V::fma(p, r, V::set1(1.0));
+    p = V::fma(p, r, V::set1(1.0));
+    return V::mul(p, V::bitsToScale(shifted));
+}
+
+// log(1 + e) for e in (0, 1] as 2 atanh(f), f = e / (2 + e), or after halving 1 + e, ln2 + 2 atanh((e - 1) / (e + 3));
+// either way |f| <= 3 - 2 sqrt(2) and the odd series converges to double precision by f^23
+template <typename V>
+inline typename V::Register log1pUnit(typename V::Register e) {
+    using R = typename V::Register;
+    const typename V::Mask small = V::lessThan(e, V::set1(0.41421356237309503)); // sqrt(2) - 1
+    const R numerator = V::select(small, e, V::sub(e, V::set1(1.0)));
+    const R denominator = V::add(e, V::select(small, V::set1(2.0), V::set1(3.0)));
+    const R f = V::div(numerator, denominator);
+    const R s = V::mul(f, f);
+
+    R p = V::set1(1.0 / 23.0);
+    p = V::fma(p, s, V::set1(1.0 / 21.0));
+    p = V::fma(p, s, V::set1(1.0 / 19.0));
+    p = V::fma(p, s, V::set1(1.0 / 17.0));
+    p = V::fma(p, s, V::set1(1.0 / 15.0));
+    p = V::fma(p, s, V::set1(1.0 / 13.0));
+    p = V::fma(p, s, V::set1(1.0 / 11.0));
+    p = V::fma(p, s, V::set1(1.0 / 9.0));
+    p = V::fma(p, s, V::set1(1.0 / 7.0));
+    p = V::fma(p, s, V::set1(1.0 / 5.0));
+    p = V::fma(p, s, V::set1(1.0 / 3.0));
+    // 2f + 2f s p, so the leading term is not rounded through the product
+    const R twoF = V::add(f, f);
+    const R series = V::fma(V::mul(twoF, s), p, twoF);
+    return V::add(series, V::select(small, V::set1(0.0), V::set1(0.69314718055994531)));
+}
+
+template <typename V>
+inline typename V::Register clampedExp(typename V::Register x) {
+    // min returns its second operand for NaN, which keeps NaN scores NaN
+    return negativeExp<V>(V::min(V::set1(EXP_ARGUMENT_LIMIT), V::abs(x)));
+}
+
+template <typename V>
+inline typename V::Register sigmoidRegister(typename V::Register x) {
+    // 1 / (1 + e^-|x|) for x >= 0 and e^-|x| / (1 + e^-|x|) below, so e^x never overflows
+    const typename V::Register e = clampedExp<V>(x);
+    const typename V::Register s = V::div(V::set1(1.0), V::add(V::set1(1.0), e));
+    return V::select(V::lessThan(x, V::set1(0.0)), V::mul(e, s), s);
+}
+
+// Runs op over full registers, then over the tail through a zero-padded buffer, so every element goes through
+// the same instructions wherever it sits in the array
+template <typename V, typename Op>
+inline void forEachRegister(size_t count, Op op) {
+    size_t i = 0;
+    for (; i + V::width <= count; i += V::width) {
+        op(i, V::width);
+    }
+    if (i < count) {
+        op(i, count - i);
+    }
+}
+
+template <typename V>
+inline typename V::Register loadPartial(const double* source, size_t count) {
+    alignas(64) double buffer[V::width] = {};
+    for (size_t k = 0; k < count; ++k) {
+        buffer[k] = source[k];
+    }
+    return V::load(buffer);
+}
+
+template <typename V>
+inline void storePartial(double* target, typename V::Register value, size_t count) {
+    alignas(64) double buffer[V::width];
+    V::store(buffer, value);
+    for (size_t k = 0; k < count; ++k) {
+        target[k] = buffer[k];
+    }
+}
+
+template <typename V>
+void sigmoid(const double* z, double bias, double* p, size_t count) {
+    const typename V::Register shift = V::set1(bias);
+    forEachRegister<V>(count, [&](size_t i, size_t lanes) {
+        if (lanes == V::width) {
+            V::store(p + i, sigmoidRegister<V>(V::add(V::load(z + i), shift)));
+        } else {
+            storePartial<V>(p + i, sigmoidRegister<V>(V::add(loadPartial<V>(z + i, lanes), shift)), lanes);
+        }
+    });
+}
+
+template <typename V>
+void logSigmoid(const double* z, double* out, size_t count) {
+    // log(1 / (1 + e^-x)) = min(x, 0) - log(1 + e^-|x|)
+    auto evaluate = [](typename V::Register x) {
+        return V::sub(V::min(x, V::set1(0.0)), log1pUnit<V>(clampedExp<V>(x)));
+    };
+    forEachRegister<V>(count, [&](size_t i, size_t lanes) {
+        if (lanes == V::width) {
+            V::store(out + i, evaluate(V::load(z + i)));
+        } else {
+            storePartial<V>(out + i, evaluate(loadPartial<V>(z + i, lanes)), lanes);
+        }
+    });
+}
+
+template <typename V>
+double logisticLoss(const double* z, double bias, const double* y, size_t count) {
+    // log(1 + e^x) - y x, written as max(x, 0) - y x + log(1 + e^-|x|)
+    using R = typename V::Register;
+    const R shift = V::set1(bias);
+    auto evaluate = [](R x, R label) {
+        return V::add(V::sub(V::max(x, V::set1(0.0)), V::mul(label, x)), log1pUnit<V>(clampedExp<V>(x)));
+    };
+    R total = V::set1(0.0);
+    forEachRegister<V>(count, [&](size_t i, size_t lanes) {
+        if (lanes == V::width) {
+            total = V::add(total, evaluate(V::add(V::load(z + i), shift), V::load(y + i)));
+        } else {
+            // Padded lanes would add log 2 each, so only the real ones are kept
+            alignas(64) double terms[V::width] = {};
+            storePartial<V>(terms, evaluate(V::add(loadPartial<V>(z + i, lanes), shift), loadPartial<V>(y + i, lanes)), lanes);
+            total = V::add(total, V::load(terms));
+        }
+    });
+    return V::sum(total);
+}
+
+}
+
+#endif // ACTIVATIONSIMD_H
@@ -0,0 +1,105 @@
+// Checks that training does not touch the heap in steady state: once a TrainingWorkspace has been through
+// one fit, further gradient descent and mini-batch SGD fits and partialFit calls on it allocate nothing.
+// Every operator new is counted, and this target compiles the training sources itself with
+// EIGEN_RUNTIME_NO_MALLOC, so an Eigen temporary anywhere in them fails the run as well.
+#include "designmatrix.h"
+#include "logisticregression.h"
+#include "threadpool.h"
+#include <atomic>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+
+namespace {
+
+std::atomic<long long> allocations(0);
+
+}
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+#define SAMPLES 70000 // more than two blocks of ParallelDesign
+#define REPEATS 3
+
+// Runs the first call to size everything, then the same call REPEATS times with every allocation forbidden
+bool steadyState(const std::string& name, const std::function<void()>& call) {
+    call();
+
+    const long long before = allocations.load();
+    Eigen::internal::set_is_malloc_allowed(false);
+    for (int i = 0; i < REPEATS; ++i) {
+        call();
+    }
+    Eigen::internal::set_is_malloc_allowed(true);
+    const long long made = allocations.load() - before;
+
+    std::cout << (made == 0 ? "ok   " : "FAIL ") << name << ": " << made << " allocations in " << REPEATS << " calls" << std::endl;
+    return made == 0;
+}
+
+std::vector<Diagram> randomDiagrams(std::mt19937& gen) {
+    std::uniform_int_distribution<int> position(0, GRID_SIZE - 1), color(1, 4), coin(0, 1);
+    std::vector<Diagram> diagrams(SAMPLES);
+    for (Diagram& diagram : diagrams) {
+        for (int k = 0; k < WIRE_COUNT; ++k) {
+            diagram.addWire(coin(gen) == 1, position(gen), color(gen));
+        }
+    }
+    return diagrams;
+}
+
+}
+
+int main() {
+    std::mt19937 gen(1);
+    std::vector<Diagram> diagrams = randomDiagrams(gen);
+    Eigen::MatrixXd features = Eigen::MatrixXd::Random(SAMPLES, 50);
+    Eigen::VectorXd labels(SAMPLES);
+    for (int i = 0; i < SAMPLES; ++i) {
+        labels(i) = (i * 7919) % 3 == 0;
+    }
+
+    ThreadPool pool(2);
+    DenseDesign dense(features);
+    DiagramDesign diagram(diagrams);
+    ParallelDesign parallel(diagram, pool);
+    const std::pair<const char*, const DesignMatrix*> designs[] = {{"dense", &dense}, {"diagram", &diagram}, {"parallel", &parallel}};
+
+    bool passed = true;
+    for (const auto& [name, design] : designs) {
+        for (SolverType solver : {SolverType::GradientDescent, SolverType::MiniBatchSGD}) {
+            LogisticRegression model(0.1, 20, 0.01, RegularizationType::L2);
+            model.setSolver(solver);
+            model.setBatchSize(128);
+            model.setTolerance(0.0);
+            TrainingWorkspace workspace;
+            const std::string solverName = solver == SolverType::GradientDescent ? " gd fit" : " sgd fit";
+            passed &= steadyState(name + solverName, [&]() { model.fit(*design, labels, workspace, nullptr); });
+        }
+
+        LogisticRegression model(0.1, 1, 0.01, RegularizationType::L1);
+        model.setBatchSize(128);
+        TrainingWorkspace workspace;
+        passed &= steadyState(std::string(name) + " partialFit", [&]() { model.partialFit(*design, labels, workspace, 2); });
+    }
+    return passed ? 0 : 1;
+}
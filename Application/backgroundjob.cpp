@@ -0,0 +1,52 @@
+#include "backgroundjob.h"
+
+BackgroundJob::BackgroundJob(std::chrono::milliseconds progressInterval) : interval(progressInterval), running(false) {}
+
+BackgroundJob::~BackgroundJob() {
+    cancel();
+    wait();
+}
+
+bool BackgroundJob::start(Task task, ProgressCallback onProgress, FinishedCallback onFinished) {
+    if (running.load()) {
+        return false;
+    }
+    wait(); // joins the thread of the previous, already finished task
+
+    token.reset();
+    running = true;
+    lastReport = std::chrono::steady_clock::time_point();
+    worker = std::thread([this, task = std::move(task), onProgress = std::move(onProgress), onFinished = std::move(onFinished)]() {
+        // Workers of a parallel task may report concurrently; only the first report of each interval gets through
+        ProgressCallback throttled = [this, &onProgress](double fraction) {
+            if (!onProgress) {
+                return;
+            }
+            auto now = std::chrono::steady_clock::now();
+            {
+                std::lock_guard<std::mutex> lock(throttleMutex);
+                if (fraction < 1.0 && now - lastReport < interval) {
+                    return;
+                }
+                lastReport = now;
+            }
+            onProgress(fraction);
+        };
+
+        bool completed = task(throttled, token) && !token.isCanceled();
+        if (completed && onProgress) {
+            onProgress(1.0);
+        }
+        if (onFinished) {
+            onFinished(completed);
+        }
+        running = false;
+    });
+    return true;
+}
+
+void BackgroundJob::wait() {
+    if (worker.joinable() && worker.get_id() != std::this_thread::get_id()) {
+        worker.join();
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef BACKGROUNDJOB_H
+#define BACKGROUNDJOB_H
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "progress.h"
+
+// Runs one task at a time on its own thread. The task reports progress through the callback it is given,
+// which forwards at most one update per interval (plus the final 1.0), and polls the token for cancellation.
+// onProgress and onFinished are called on the job thread; a GUI forwards them to its own thread.
+class BackgroundJob {
+public:
+    using Task = std::function<bool(const ProgressCallback& onProgress, const CancellationToken& cancel)>; // false: stopped early
+    using FinishedCallback = std::function<void(bool completed)>;
+
+    explicit BackgroundJob(std::chrono::milliseconds progressInterval = std::chrono::milliseconds(50));
+    ~BackgroundJob(); // cancels a running task and waits for it
+
+    BackgroundJob(const BackgroundJob&) = delete;
+    BackgroundJob& operator=(const BackgroundJob&) = delete;
+
+    // Returns false if a task is still running
+    bool start(Task task, ProgressCallback onProgress, FinishedCallback onFinished);
+    void cancel() { token.cancel(); }
+    void wait();
+    bool isRunning() const { return running.load(); }
+
+private:
+    std::chrono::milliseconds interval;
+    CancellationToken token;
+    std::atomic<bool> running;
+    std::thread worker;
+    std::mutex throttleMutex;
+    std::chrono::steady_clock::time_point lastReport;
+};
+
+#endif // BACKGROUNDJOB_H
@@ -0,0 +1,352 @@
+// Throughput of each pipeline stage at several dataset sizes and thread counts:
+//   diagrambench [--sizes 10000,100000,1000000] [--threads 1,2,4] [--repeat 3] [--json out.json]
+//                [--baseline old.json [--tolerance 0.10]]
+// One line per measurement on stdout (ns/op, rows/s, MB/s, peak RSS). With --json the same results are
+// written one object per line, so a later run can compare against them with --baseline; a stage that got
+// slower than the baseline by more than the tolerance is reported and makes the exit status 1.
+#include "activation.h"
+#include "datagenerator.h"
+#include "diagramsink.h"
+#include "csvparser.h"
+#include "datasetcache.h"
+#include "designmatrix.h"
+#include "featureencoder.h"
+#include "inference.h"
+#include "logisticregression.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#define BENCH_SEED 12345
+#define FIT_ITERATIONS 10
+
+namespace {
+
+struct Measurement {
+    std::string stage;
+    size_t rows;
+    size_t threads;
+    double seconds;     // best of the repeats
+    double operations;  // what ns/op divides by
+    double bytes;       // 0 when MB/s does not apply
+    double peakRssMb;   // of the whole process so far
+};
+
+double peakRssMegabytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1e6;
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1e6; // bytes
+#else
+    return usage.ru_maxrss / 1e3; // kilobytes
+#endif
+#endif
+}
+
+// Counts the rows without keeping them, so generation is measured on its own
+class NullSink : public DiagramSink {
+public:
+    void write(const Diagram*, const uint8_t*, size_t count) override { rows += count; }
+    size_t rows = 0;
+};
+
+class NullScoreSink : public ScoreSink {
+public:
+    void write(const double*, const uint8_t*, size_t count) override { rows += count; }
+    size_t rows = 0;
+};
+
+double bestSeconds(int repeat, const std::function<void()>& run) {
+    double best = 1e300;
+    for (int i = 0; i < repeat; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+std::vector<size_t> parseList(const std::string& text) {
+    std::vector<size_t> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        values.push_back(std::stoull(item));
+    }
+    return values;
+}
+
+std::string key(const std::string& stage, size_t rows, size_t threads) {
+    return stage + "/" + std::to_string(rows) + "/" + std::to_string(threads);
+}
+
+std::string toJson(const Measurement& m) {
+    std::ostringstream out;
+    out << std::setprecision(6) << "{\"stage\":\"" << m.stage << "\",\"rows\":" << m.rows << ",\"threads\":" << m.threads
+        << ",\"seconds\":" << m.seconds << ",\"ns_per_op\":" << m.seconds * 1e9 / m.operations
+        << ",\"rows_per_second\":" << m.rows / m.seconds
+        << ",\"megabytes_per_second\":" << (m.bytes > 0 ? m.bytes / 1e6 / m.seconds : 0.0)
+        << ",\"peak_rss_mb\":" << m.peakRssMb << "}";
+    return out.str();
+}
+
+// Reads back what --json wrote: one object per line, only the fields the comparison needs
+std::map<std::string, double> readBaseline(const std::string& path) {
+    std::map<std::string, double> nsPerOp;
+    std::ifstream file(path);
+    std::string line;
+    auto field = [&line](const std::string& name) {
+        size_t at = line.find("\"" + name + "\":");
+        if (at == std::string::npos) {
+            return std::string();
+        }
+        at += name.size() + 3;
+        size_t end = line.find_first_of(",}", at);
+        std::string value = line.substr(at, end - at);
+        value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+        return value;
+    };
+    while (std::getline(file, line)) {
+        std::string stage = field("stage");
+        if (!stage.empty()) {
+            nsPerOp[key(stage, std::stoull(field("rows")), std::stoull(field("threads")))] = std::stod(field("ns_per_op"));
+        }
+    }
+    return nsPerOp;
+}
+
+}
+
+int main(int argc, char** argv) {
+    std::map<std::string, std::string> options = {{"sizes", "10000,100000,1000000"}, {"threads", "1,2,4"},
+                                                  {"repeat", "3"}, {"tolerance", "0.10"}};
+    for (int i = 1; i + 1 < argc; i += 2) {
+        options[std::string(argv[i]).substr(2)] = argv[i + 1];
+    }
+    const std::vector<size_t> sizes = parseList(options["sizes"]);
+    const std::vector<size_t> threadCounts = parseList(options["threads"]);
+    const int repeat = std::stoi(options["repeat"]);
+
+    std::vector<Measurement> results;
+    auto record = [&results](Measurement m) {
+        m.peakRssMb = peakRssMegabytes();
+        std::cout << std::left << std::setw(20) << m.stage << std::right << std::setw(9) << m.rows << " rows "
+                  << std::setw(2) << m.threads << " threads " << std::fixed << std::setprecision(1)
+                  << std::setw(10) << m.seconds * 1e9 / m.operations << " ns/op " << std::setw(13) << m.rows / m.seconds << " rows/s ";
+        if (m.bytes > 0) {
+            std::cout << std::setw(8) << m.bytes / 1e6 / m.seconds << " MB/s ";
+        }
+        std::cout << std::setw(8) << m.peakRssMb << " MB peak" << std::defaultfloat << std::endl;
+        results.push_back(m);
+    };
+
+    const std::string csvPath = (std::filesystem::temp_directory_path() / "diagrambench.csv").string();
+    const std::string binaryPath = (std::filesystem::temp_directory_path() / "diagrambench.bin").string();
+
+    for (size_t rows : sizes) {
+        // One dataset per size, shared by every stage below
+        std::vector<Diagram> diagrams;
+        Eigen::VectorXd labels;
+        {
+            ThreadPool pool;
+            MemorySink memory;
+            CsvSink csv(csvPath, false);
+            BinarySink binary(binaryPath);
+            TeeSink files(csv, binary);
+            TeeSink sink(files, memory);
+            DataGenerator::generateBulk(rows, BENCH_SEED, pool, sink);
+            diagrams = memory.diagrams();
+            labels = memory.labels();
+        }
+        const double csvBytes = static_cast<double>(std::filesystem::file_size(csvPath));
+        const double binaryBytes = static_cast<double>(std::filesystem::file_size(binaryPath));
+
+        // Single-threaded stages
+        {
+            std::seed_seq seeds{BENCH_SEED};
+            DataGenerator generator(seeds);
+            double seconds = bestSeconds(repeat, [&]() {
+                for (size_t i = 0; i < rows; ++i) {
+                    generator.generateDiagram();
+                }
+            });
+            record({"generate_diagram", rows, 1, seconds, double(rows), 0.0, 0.0});
+        }
+        {
+            std::vector<Diagram> loaded;
+            Eigen::VectorXd loadedLabels;
+            double seconds = bestSeconds(repeat, [&]() { readDiagramFile(binaryPath, loaded, loadedLabels); });
+            record({"load_binary", rows, 1, seconds, double(rows), binaryBytes, 0.0});
+        }
+        {
+            DiagramDesign design(diagrams);
+            Eigen::VectorXd w = Eigen::VectorXd::Constant(design.cols(), 0.01);
+            Eigen::VectorXd z, g;
+            double seconds = bestSeconds(repeat, [&]() {
+                design.multiply(w, z);
+                design.transposeMultiply(z, g);
+            });
+            record({"gradient_products", rows, 1, seconds, double(rows), 0.0, 0.0});
+
+            // The same products over the low-dimensional encoders
+            for (FeatureEncoding encoding : {FeatureEncoding::WireSequence, FeatureEncoding::ColorOrder}) {
+                const FeatureEncoder& encoder = featureEncoder(encoding);
+                std::unique_ptr<DesignMatrix> encoded = encoder.design(diagrams);
+                Eigen::VectorXd encodedWeights = Eigen::VectorXd::Constant(encoder.featureCount(), 0.01);
+                seconds = bestSeconds(repeat, [&]() {
+                    encoded->multiply(encodedWeights, z);
+                    encoded->transposeMultiply(z, g);
+                });
+                record({std::string("gradient_products_") + encoder.name(), rows, 1, seconds, double(rows), 0.0, 0.0});
+            }
+
+            // Sigmoid and log loss over the scores of these products: the per-element std::exp loop they replaced,
+            // then every kernel this CPU has
+            Eigen::VectorXd p(rows);
+            double loss = 0.0;
+            seconds = bestSeconds(repeat, [&]() {
+                for (size_t i = 0; i < rows; ++i) {
+                    p(i) = 1.0 / (1.0 + std::exp(-(z(i) + 0.1)));
+                }
+            });
+            record({"sigmoid_reference", rows, 1, seconds, double(rows), 0.0, 0.0});
+            seconds = bestSeconds(repeat, [&]() {
+                loss = 0.0;
+                for (size_t i = 0; i < rows; ++i) {
+                    double x = z(i) + 0.1;
+                    loss += std::max(x, 0.0) - labels(i) * x + std::log1p(std::exp(-std::abs(x)));
+                }
+            });
+            record({"log_loss_reference", rows, 1, seconds, double(rows), 0.0, 0.0});
+
+            const ActivationKernel dispatched = activationKernel();
+            for (ActivationKernel kernel : {ActivationKernel::Scalar, ActivationKernel::Avx2, ActivationKernel::Avx512}) {
+                if (!setActivationKernel(kernel)) {
+                    continue;
+                }
+                const std::string suffix = std::string("_") + activationKernelName(kernel);
+                seconds = bestSeconds(repeat, [&]() { sigmoid(z.data(), 0.1, p.data(), rows); });
+                record({"sigmoid" + suffix, rows, 1, seconds, double(rows), 0.0, 0.0});
+                seconds = bestSeconds(repeat, [&]() { loss = logisticLoss(z.data(), 0.1, labels.data(), rows); });
+                record({"log_loss" + suffix, rows, 1, seconds, double(rows), 0.0, 0.0});
+            }
+            setActivationKernel(dispatched);
+
+            LogisticRegression model(0.1, FIT_ITERATIONS, 0.01, RegularizationType::L1);
+            seconds = bestSeconds(repeat, [&]() { model.fit(design, labels, nullptr); });
+            record({"fit_iteration", rows, 1, seconds, double(rows) * FIT_ITERATIONS, 0.0, 0.0});
+
+            std::vector<Diagram> single(1);
+            const size_t calls = std::min<size_t>(rows, 100000);
+            seconds = bestSeconds(repeat, [&]() {
+                for (size_t i = 0; i < calls; ++i) {
+                    single[0] = diagrams[i];
+                    model.predict(DiagramDesign(single));
+                }
+            });
+            record({"predict_single", calls, 1, seconds, double(calls), 0.0, 0.0});
+        }
+
+        // Pool stages at every thread count
+        for (size_t threads : threadCounts) {
+            ThreadPool pool(threads);
+            {
+                // Full-batch products and fit iterations of the final fit, blocked over the pool
+                DiagramDesign design(diagrams);
+                ParallelDesign parallel(design, pool);
+                Eigen::VectorXd w = Eigen::VectorXd::Constant(design.cols(), 0.01);
+                Eigen::VectorXd z, g;
+                double seconds = bestSeconds(repeat, [&]() {
+                    parallel.multiply(w, z);
+                    parallel.transposeMultiply(z, g);
+                });
+                record({"gradient_products_parallel", rows, threads, seconds, double(rows), 0.0, 0.0});
+
+                LogisticRegression model(0.1, FIT_ITERATIONS, 0.01, RegularizationType::L1);
+                seconds = bestSeconds(repeat, [&]() { model.fit(parallel, labels, nullptr); });
+                record({"fit_iteration_parallel", rows, threads, seconds, double(rows) * FIT_ITERATIONS, 0.0, 0.0});
+            }
+            {
+                NullSink sink;
+                double seconds = bestSeconds(repeat, [&]() { DataGenerator::generateBulk(rows, BENCH_SEED, pool, sink); });
+                record({"generate_bulk", rows, threads, seconds, double(rows), 0.0, 0.0});
+            }
+            {
+                std::vector<Diagram> parsed;
+                Eigen::VectorXd parsedLabels;
+                std::vector<CsvParseError> errors;
+                CsvParseStats stats;
+                double seconds = bestSeconds(repeat, [&]() { parseDiagramCsv(csvPath, pool, parsed, parsedLabels, errors, stats); });
+                record({"parse_csv", rows, threads, seconds, double(rows), csvBytes, 0.0});
+            }
+            {
+                LogisticRegression model(0.1, 1, 0.01, RegularizationType::L1);
+                model.setWeights(Eigen::VectorXd::Constant(DENSE_FEATURES, 0.01));
+                NullScoreSink sink;
+                const FeatureEncoder& grid = featureEncoder(FeatureEncoding::Grid);
+                double seconds = bestSeconds(repeat, [&]() { scoreDiagrams(model, grid, diagrams.data(), rows, pool, sink); });
+                record({"score_batch", rows, threads, seconds, double(rows), 0.0, 0.0});
+
+                std::vector<CsvParseError> errors;
+                CsvParseStats stats;
+                seconds = bestSeconds(repeat, [&]() { scoreDiagramCsv(model, grid, csvPath, pool, sink, errors, stats); });
+                record({"score_csv", rows, threads, seconds, double(rows), csvBytes, 0.0});
+            }
+        }
+    }
+    std::remove(csvPath.c_str());
+    std::remove(binaryPath.c_str());
+
+    if (options.count("json")) {
+        std::ofstream json(options["json"]);
+        for (const Measurement& m : results) {
+            json << toJson(m) << "\n";
+        }
+    }
+
+    int status = 0;
+    if (options.count("baseline")) {
+        const double tolerance = std::stod(options["tolerance"]);
+        std::map<std::string, double> baseline = readBaseline(options["baseline"]);
+        std::cout << "\nCompared with " << options["baseline"] << " (ns/op, lower is better):" << std::endl;
+        for (const Measurement& m : results) {
+            auto previous = baseline.find(key(m.stage, m.rows, m.threads));
+            if (previous == baseline.end()) {
+                continue;
+            }
+            double current = m.seconds * 1e9 / m.operations;
+            double change = current / previous->second - 1.0;
+            bool regressed = change > tolerance;
+            std::cout << (regressed ? "REGRESSION " : "           ") << std::left << std::setw(30) << previous->first << std::right
+                      << std::fixed << std::setprecision(1) << std::setw(10) << previous->second << " -> " << std::setw(10)
+                      << current << std::showpos << std::setw(8) << change * 100 << "%" << std::noshowpos << std::defaultfloat << std::endl;
+            if (regressed) {
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
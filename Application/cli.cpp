@@ -0,0 +1,319 @@
+// Headless front end to the core library:
+//   diagramcli generate --count N [--seed S] --output diagrams.csv [--binary diagrams.bin]
+//   diagramcli train    --data diagrams.csv --model model.bin [--solver gd|sgd|lbfgs|newton] [--storage diagram|dense|uint8|float32]
+//                       [--encoding grid|sequence|order] [--folds K] [--patience N]
+//   diagramcli evaluate --data diagrams.csv --model model.bin
+//   diagramcli score    --input diagrams.csv --model model.bin --output scores.csv
+// Every command also takes --threads N (default: one per hardware thread).
+// Each command prints one JSON object on stdout; logs and progress go to stderr.
+#include "machinelearning.h"
+#include "datagenerator.h"
+#include "diagramsink.h"
+#include "csvparser.h"
+#include "evaluation.h"
+#include "inference.h"
+#include "modelfile.h"
+#include "threadpool.h"
+#include <charconv>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+
+namespace {
+
+using Options = std::map<std::string, std::string>;
+
+int usage() {
+    std::cerr << "usage: diagramcli generate --count N [--seed S] --output FILE.csv [--binary FILE.bin]\n"
+                 "       diagramcli train --data FILE.csv --model FILE [--solver gd|sgd|lbfgs|newton]"
+                 " [--storage diagram|dense|uint8|float32] [--encoding grid|sequence|order] [--folds K] [--patience N] [--progress]\n"
+                 "       diagramcli evaluate --data FILE.csv --model FILE\n"
+                 "       diagramcli score --input FILE.csv --model FILE --output FILE.csv\n"
+                 "every command also takes --threads N\n";
+    return 2;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 2; i < argc; ++i) {
+        std::string key = argv[i];
+        if (key.rfind("--", 0) != 0) {
+            return false;
+        }
+        key = key.substr(2);
+        if (key == "progress") {
+            options[key] = "1";
+        } else if (i + 1 < argc) {
+            options[key] = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool require(const Options& options, std::initializer_list<const char*> keys) {
+    for (const char* key : keys) {
+        if (options.count(key) == 0) {
+            std::cerr << "missing --" << key << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads a whole option value as a non-negative number; false if it is not one or does not fit
+template <typename T>
+bool parseNumber(const std::string& text, T& value) {
+    auto [end, code] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return code == std::errc() && end == text.data() + text.size() && value >= 0;
+}
+
+// An absent option keeps the value it is given
+template <typename T>
+bool numberOption(const Options& options, const char* key, T& value) {
+    return options.count(key) == 0 || parseNumber(options.at(key), value);
+}
+
+bool threadCount(const Options& options, size_t& threads) {
+    threads = std::thread::hardware_concurrency();
+    return numberOption(options, "threads", threads);
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printMetrics(std::ostream& out, const EvaluationReport& report) {
+    out << "\"accuracy\":" << report.best.accuracy << ",\"threshold\":" << report.best.threshold
+        << ",\"precision\":" << report.best.precision << ",\"recall\":" << report.best.recall
+        << ",\"f1\":" << report.best.f1 << ",\"roc_auc\":" << report.rocAuc
+        << ",\"average_precision\":" << report.averagePrecision;
+}
+
+int generate(const Options& options, std::ostream& out) {
+    if (!require(options, {"count", "output"})) {
+        return 2;
+    }
+    size_t count = 0;
+    uint32_t seed = std::random_device{}();
+    size_t threads;
+    if (!parseNumber(options.at("count"), count) || !numberOption(options, "seed", seed) || !threadCount(options, threads)) {
+        return usage();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    ThreadPool pool(threads);
+    CsvSink csv(options.at("output"), false);
+    if (!csv.isOpen()) {
+        std::cerr << "Error: could not create " << options.at("output") << std::endl;
+        return 1;
+    }
+    if (options.count("binary")) {
+        BinarySink binary(options.at("binary"));
+        TeeSink sink(csv, binary);
+        DataGenerator::generateBulk(count, seed, pool, sink);
+    } else {
+        DataGenerator::generateBulk(count, seed, pool, csv);
+    }
+
+    double seconds = secondsSince(start);
+    out << "{\"command\":\"generate\",\"count\":" << count << ",\"seed\":" << seed
+        << ",\"seconds\":" << seconds << ",\"rows_per_second\":" << count / seconds << "}" << std::endl;
+    return 0;
+}
+
+int train(const Options& options, std::ostream& out) {
+    if (!require(options, {"data", "model"})) {
+        return 2;
+    }
+    size_t threads;
+    int folds = 0, patience = 0;
+    if (!threadCount(options, threads) || !numberOption(options, "folds", folds) || !numberOption(options, "patience", patience)) {
+        return usage();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MachineLearning ml(options.at("data"));
+    ml.setThreadCount(threads);
+
+    static const std::map<std::string, SolverType> solvers = {
+        {"gd", SolverType::GradientDescent}, {"sgd", SolverType::MiniBatchSGD},
+        {"lbfgs", SolverType::LBFGS}, {"newton", SolverType::Newton}};
+    static const std::map<std::string, FeatureStorage> storages = {
+        {"diagram", FeatureStorage::Diagram}, {"dense", FeatureStorage::Dense},
+        {"uint8", FeatureStorage::Uint8}, {"float32", FeatureStorage::Float32}};
+    if (options.count("solver")) {
+        if (!solvers.count(options.at("solver"))) {
+            return usage();
+        }
+        ml.setSolver(solvers.at(options.at("solver")));
+    }
+    if (options.count("storage")) {
+        if (!storages.count(options.at("storage"))) {
+            return usage();
+        }
+        ml.setFeatureStorage(storages.at(options.at("storage")));
+    }
+    if (options.count("encoding")) {
+        FeatureEncoding encoding;
+        if (!parseFeatureEncoding(options.at("encoding"), encoding)) {
+            return usage();
+        }
+        ml.setFeatureEncoding(encoding);
+    }
+
+    if (options.count("folds")) {
+        ml.setCrossValidationFolds(folds);
+    }
+    if (options.count("patience")) {
+        ml.setEarlyStoppingPatience(patience);
+    }
+
+    // Options are checked before the data is read, so a typo does not cost a parse
+    if (!ml.loadDataset()) {
+        std::cerr << "Error: no rows loaded from " << options.at("data") << std::endl;
+        return 1;
+    }
+    ProgressCallback onProgress;
+    if (options.count("progress")) {
+        onProgress = [](double fraction) { std::cerr << "progress " << fraction << std::endl; };
+    }
+    if (!ml.train(onProgress) || !ml.isTrained()) {
+        std::cerr << "Error: training on " << options.at("data") << " failed; no model written" << std::endl;
+        return 1;
+    }
+    if (!ml.saveModel(options.at("model"))) {
+        return 1;
+    }
+
+    const LogisticRegression& model = ml.getModel();
+    out << "{\"command\":\"train\",\"encoding\":\"" << featureEncoder(ml.getFeatureEncoding()).name()
+        << "\",\"features\":" << model.getWeights().size() << ",\"learning_rate\":" << model.getLearningRate()
+        << ",\"regularization\":" << model.getRegularizationStrength() << ",\"model_threshold\":" << model.getThreshold()
+        << ",\"iterations\":" << model.getLossHistory().iterationsRun << ",";
+    printMetrics(out, ml.evaluate());
+    out << ",\"seconds\":" << secondsSince(start) << "}" << std::endl;
+    return 0;
+}
+
+bool loadModelOrReport(const std::string& path, LogisticRegression& model, FeatureEncoding& encoding) {
+    std::string error;
+    if (!loadModel(path, model, encoding, error)) {
+        std::cerr << "Error: " << path << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int evaluate(const Options& options, std::ostream& out) {
+    if (!require(options, {"data", "model"})) {
+        return 2;
+    }
+    size_t threads;
+    if (!threadCount(options, threads)) {
+        return usage();
+    }
+    LogisticRegression model(0.0, 0, 0.0);
+    FeatureEncoding encoding;
+    if (!loadModelOrReport(options.at("model"), model, encoding)) {
+        return 1;
+    }
+
+    ThreadPool pool(threads);
+    std::vector<Diagram> diagrams;
+    Eigen::VectorXd labels;
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    if (!parseDiagramCsv(options.at("data"), pool, diagrams, labels, errors, stats)) {
+        std::cerr << "Error: could not open " << options.at("data") << std::endl;
+        return 1;
+    }
+
+    MemoryScoreSink scores;
+    if (!scoreDiagrams(model, featureEncoder(encoding), diagrams.data(), diagrams.size(), pool, scores)) {
+        std::cerr << "Error: " << options.at("model") << " does not match its feature encoding" << std::endl;
+        return 1;
+    }
+    Eigen::Map<const Eigen::VectorXd> probabilities(scores.probabilities().data(), scores.probabilities().size());
+    EvaluationReport report = evaluateProbabilities(probabilities, labels);
+
+    // Accuracy at the threshold stored in the model, next to the best one this data would allow
+    double correct = 0;
+    for (size_t i = 0; i < scores.labels().size(); ++i) {
+        correct += scores.labels()[i] == labels(i);
+    }
+    out << "{\"command\":\"evaluate\",\"rows\":" << diagrams.size() << ",\"malformed\":" << errors.size()
+        << ",\"model_threshold\":" << model.getThreshold() << ",\"model_accuracy\":" << (diagrams.empty() ? 0.0 : correct / diagrams.size()) << ",";
+    printMetrics(out, report);
+    out << "}" << std::endl;
+    return 0;
+}
+
+int score(const Options& options, std::ostream& out) {
+    if (!require(options, {"input", "model", "output"})) {
+        return 2;
+    }
+    size_t threads;
+    if (!threadCount(options, threads)) {
+        return usage();
+    }
+    LogisticRegression model(0.0, 0, 0.0);
+    FeatureEncoding encoding;
+    if (!loadModelOrReport(options.at("model"), model, encoding)) {
+        return 1;
+    }
+
+    ThreadPool pool(threads);
+    CsvScoreSink sink(options.at("output"));
+    if (!sink.isOpen()) {
+        std::cerr << "Error: could not create " << options.at("output") << std::endl;
+        return 1;
+    }
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    if (!scoreDiagramCsv(model, featureEncoder(encoding), options.at("input"), pool, sink, errors, stats)) {
+        std::cerr << "Error: could not open " << options.at("input") << std::endl;
+        return 1;
+    }
+    for (const CsvParseError& error : errors) {
+        std::cerr << options.at("input") << ":" << error.line << ": " << error.message << std::endl;
+    }
+
+    out << "{\"command\":\"score\",\"rows\":" << stats.rows << ",\"malformed\":" << errors.size()
+        << ",\"seconds\":" << stats.seconds << ",\"rows_per_second\":" << (stats.seconds > 0 ? stats.rows / stats.seconds : 0.0)
+        << ",\"megabytes_per_second\":" << stats.megabytesPerSecond() << "}" << std::endl;
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (argc < 2 || !parseOptions(argc, argv, options)) {
+        return usage();
+    }
+
+    // The library logs to std::cout; send that to stderr so stdout carries only the JSON result
+    std::ostream result(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    std::string command = argv[1];
+    int status;
+    if (command == "generate") {
+        status = generate(options, result);
+    } else if (command == "train") {
+        status = train(options, result);
+    } else if (command == "evaluate") {
+        status = evaluate(options, result);
+    } else if (command == "score") {
+        status = score(options, result);
+    } else {
+        status = usage();
+    }
+
+    std::cout.rdbuf(result.rdbuf());
+    return status;
+}
@@ -0,0 +1,55 @@
+#include "cpufeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+enum class Extension {
+    Avx2Fma,
+    Avx512f
+};
+
+bool supports(Extension extension) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    const bool fma = (info[2] >> 12) & 1;
+    const bool osxsave = (info[2] >> 27) & 1;
+    if (!osxsave) {
+        return false;
+    }
+    // The OS must save the YMM (and for AVX-512 the opmask and ZMM) state on context switches
+    const unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (extension == Extension::Avx2Fma) {
+        return fma && ((info[1] >> 5) & 1) && (xcr0 & 0x6) == 0x6;
+    }
+    return ((info[1] >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    if (extension == Extension::Avx2Fma) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return __builtin_cpu_supports("avx512f");
+#else
+    (void)extension;
+    return false;
+#endif
+}
+
+}
+
+bool cpuHasAvx2Fma() {
+    static const bool supported = supports(Extension::Avx2Fma);
+    return supported;
+}
+
+bool cpuHasAvx512f() {
+    static const bool supported = supports(Extension::Avx512f);
+    return supported;
+}
@@ -0,0 +1,9 @@
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+// What the running CPU and OS support, for kernels compiled with instruction set flags of their own
+// and picked at run time. Both are false on other architectures.
+bool cpuHasAvx2Fma();
+bool cpuHasAvx512f();
+
+#endif // CPUFEATURES_H
@@ -0,0 +1,219 @@
+#include "csvparser.h"
+#include "mappedfile.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <future>
+
+namespace {
+
+const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    size_t firstLine = 0;   // line number of the chunk's first line, 1-based
+    size_t lineCount = 0;
+    size_t outputStart = 0; // first slot of the output reserved for this chunk
+    size_t parsed = 0;
+    std::vector<CsvParseError> errors;
+};
+
+// Returns the text up to the next separator and advances rest past it
+inline std::string_view nextToken(std::string_view& rest, char separator) {
+    size_t end = rest.find(separator);
+    std::string_view token = rest.substr(0, end);
+    rest = (end == std::string_view::npos) ? std::string_view() : rest.substr(end + 1);
+    return token;
+}
+
+bool parseWire(std::string_view cell, Diagram& diagram, std::string& error) {
+    cell = trimCell(cell);
+    std::string_view orientation = nextToken(cell, ' ');
+    std::string_view number = nextToken(cell, ' ');
+    std::string_view color = trimCell(cell);
+
+    if (orientation != "Row" && orientation != "Column") {
+        error = "expected Row or Column, got '" + std::string(orientation) + "'";
+        return false;
+    }
+
+    int position = 0;
+    auto [end, code] = std::from_chars(number.data(), number.data() + number.size(), position);
+    if (code != std::errc() || end != number.data() + number.size() || position < 1 || position > GRID_SIZE) {
+        error = "bad position '" + std::string(number) + "'";
+        return false;
+    }
+
+    int value = encodeColor(color);
+    if (value == 0) {
+        error = "unknown color '" + std::string(color) + "'";
+        return false;
+    }
+
+    if (!diagram.addWire(orientation == "Row", position - 1, value)) {
+        error = "more than " + std::to_string(WIRE_COUNT) + " wires";
+        return false;
+    }
+    return true;
+}
+
+void parseChunk(Chunk& chunk, Diagram* diagrams, double* labels) {
+    std::string error;
+    size_t lineNumber = chunk.firstLine;
+    const char* cursor = chunk.begin;
+
+    while (cursor < chunk.end) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', chunk.end - cursor));
+        const char* lineEnd = newline ? newline : chunk.end;
+        std::string_view line = trimCell(std::string_view(cursor, lineEnd - cursor));
+        cursor = lineEnd + 1;
+
+        if (!line.empty()) {
+            Diagram diagram;
+            int label;
+            if (parseDiagramLine(line, diagram, label, error)) {
+                diagrams[chunk.outputStart + chunk.parsed] = diagram;
+                labels[chunk.outputStart + chunk.parsed] = label;
+                ++chunk.parsed;
+            } else {
+                chunk.errors.push_back({lineNumber, error});
+            }
+        }
+        ++lineNumber;
+    }
+}
+
+bool parseWires(std::string_view wires, Diagram& diagram, std::string& error) {
+    diagram = Diagram();
+    while (!wires.empty()) {
+        if (!parseWire(nextToken(wires, ','), diagram, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+std::string_view trimCell(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+bool parseDiagramLine(std::string_view line, Diagram& diagram, int& label, std::string& error) {
+    // The last cell is the label, every cell before it a wire
+    size_t lastComma = line.rfind(',');
+    if (lastComma == std::string_view::npos) {
+        error = "no label column";
+        return false;
+    }
+
+    std::string_view status = trimCell(line.substr(lastComma + 1));
+    if (status == "Dangerous") {
+        label = 1;
+    } else if (status == "Safe") {
+        label = 0;
+    } else {
+        error = "unknown label '" + std::string(status) + "'";
+        return false;
+    }
+
+    return parseWires(line.substr(0, lastComma), diagram, error);
+}
+
+bool parseDiagramWires(std::string_view line, Diagram& diagram, std::string& error) {
+    size_t lastComma = line.rfind(',');
+    std::string_view last = trimCell(lastComma == std::string_view::npos ? line : line.substr(lastComma + 1));
+    if (last == "Dangerous" || last == "Safe") {
+        line = lastComma == std::string_view::npos ? std::string_view() : line.substr(0, lastComma);
+    }
+    return parseWires(line, diagram, error);
+}
+
+bool parseDiagramCsv(const std::string& path, ThreadPool& pool, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels,
+                     std::vector<CsvParseError>& errors, CsvParseStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    // Cut the file into roughly equal chunks, each ending just after a newline
+    const char* data = file.data();
+    const char* fileEnd = data + file.size();
+    size_t chunkCount = std::max<size_t>(1, std::min(pool.size() * 4, file.size() / MIN_CHUNK_BYTES));
+    std::vector<Chunk> chunks;
+    const char* chunkBegin = data;
+    for (size_t i = 1; i <= chunkCount && chunkBegin < fileEnd; ++i) {
+        const char* chunkEnd = (i == chunkCount) ? fileEnd : std::max(chunkBegin, data + file.size() * i / chunkCount);
+        if (chunkEnd < fileEnd) {
+            const char* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', fileEnd - chunkEnd));
+            chunkEnd = newline ? newline + 1 : fileEnd;
+        }
+        Chunk chunk;
+        chunk.begin = chunkBegin;
+        chunk.end = chunkEnd;
+        chunks.push_back(std::move(chunk));
+        chunkBegin = chunkEnd;
+    }
+
+    // Pass 1: count lines per chunk, which fixes every chunk's line numbers and output range
+    std::vector<std::future<void>> pending;
+    for (Chunk& chunk : chunks) {
+        pending.push_back(pool.submit([&chunk]() {
+            chunk.lineCount = std::count(chunk.begin, chunk.end, '\n');
+            if (chunk.end > chunk.begin && chunk.end[-1] != '\n') {
+                ++chunk.lineCount; // last line without a trailing newline
+            }
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+
+    size_t totalLines = 0;
+    for (Chunk& chunk : chunks) {
+        chunk.firstLine = totalLines + 1;
+        chunk.outputStart = totalLines;
+        totalLines += chunk.lineCount;
+    }
+
+    // Pass 2: parse every chunk into its own slice of the output
+    diagrams.resize(totalLines);
+    labels.resize(totalLines);
+    pending.clear();
+    for (Chunk& chunk : chunks) {
+        pending.push_back(pool.submit([&chunk, &diagrams, &labels]() {
+            parseChunk(chunk, diagrams.data(), labels.data());
+        }));
+    }
+    for (auto& task : pending) {
+        task.get();
+    }
+
+    // Close the gaps left by blank and malformed lines
+    size_t rows = 0;
+    errors.clear();
+    for (Chunk& chunk : chunks) {
+        if (rows != chunk.outputStart) {
+            std::copy_n(diagrams.begin() + chunk.outputStart, chunk.parsed, diagrams.begin() + rows);
+            labels.segment(rows, chunk.parsed) = labels.segment(chunk.outputStart, chunk.parsed).eval();
+        }
+        rows += chunk.parsed;
+        errors.insert(errors.end(), chunk.errors.begin(), chunk.errors.end());
+    }
+    diagrams.resize(rows);
+    labels.conservativeResize(rows);
+
+    stats.bytes = file.size();
+    stats.rows = rows;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
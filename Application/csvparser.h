@@ -0,0 +1,41 @@
+#ifndef CSVPARSER_H
+#define CSVPARSER_H
+
+#include <Eigen/Dense>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "diagram.h"
+#include "threadpool.h"
+
+struct CsvParseError {
+    size_t line; // 1-based
+    std::string message;
+};
+
+struct CsvParseStats {
+    size_t bytes = 0;
+    size_t rows = 0;
+    double seconds = 0.0;
+
+    double megabytesPerSecond() const { return seconds > 0 ? bytes / 1e6 / seconds : 0.0; }
+};
+
+// Parses one "Row 13 Green,Column 16 Blue,...,Safe" line (positions 1-based). Returns false and sets
+// error if the line is malformed.
+bool parseDiagramLine(std::string_view line, Diagram& diagram, int& label, std::string& error);
+
+// Parses the wire cells of a line to be scored. A trailing Dangerous/Safe cell is allowed and ignored,
+// so labelled dataset files can be scored as well as unlabelled ones.
+bool parseDiagramWires(std::string_view line, Diagram& diagram, std::string& error);
+
+// Removes leading blanks and trailing blanks or '\r'
+std::string_view trimCell(std::string_view text);
+
+// Maps the CSV and parses it on the pool in newline-aligned chunks, writing straight into the
+// preallocated diagrams/labels. Malformed rows are skipped and listed in errors with their line number.
+// Returns false only if the file cannot be opened.
+bool parseDiagramCsv(const std::string& path, ThreadPool& pool, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels,
+                     std::vector<CsvParseError>& errors, CsvParseStats& stats);
+
+#endif // CSVPARSER_H
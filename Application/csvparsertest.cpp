@@ -0,0 +1,127 @@
+// CSV parsing: single lines parse to the expected wires and labels, each kind of malformed line is rejected
+// with a message, and a file split into several chunks keeps the row order and reports malformed rows at
+// their 1-based line numbers.
+#include "csvparser.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+#define LARGE_FILE_LINES 200000 // about 6 MB, so the parse runs in several 1 MB chunks
+#define MALFORMED_EVERY 7919
+
+bool check(bool condition, const std::string& name) {
+    std::cout << (condition ? "ok   " : "FAIL ") << name << std::endl;
+    return condition;
+}
+
+bool rejected(std::string_view line, const std::string& name) {
+    Diagram diagram;
+    int label;
+    std::string error;
+    bool failed = !parseDiagramLine(line, diagram, label, error) && !error.empty();
+    return check(failed, name + (failed ? " (" + error + ")" : ""));
+}
+
+// Line i of the large file: a valid row, or a malformed one every MALFORMED_EVERY lines
+std::string largeFileLine(int i) {
+    if (i % MALFORMED_EVERY == 0) {
+        return "Row 1 Purple,Safe";
+    }
+    return "Row " + std::to_string(i % GRID_SIZE + 1) + " Red,Column " + std::to_string(i / GRID_SIZE % GRID_SIZE + 1)
+           + " Blue," + (i % 3 == 0 ? "Dangerous" : "Safe");
+}
+
+bool parsesLargeFile(const std::string& path) {
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        for (int i = 1; i <= LARGE_FILE_LINES; ++i) {
+            out << largeFileLine(i) << "\n";
+        }
+    }
+
+    ThreadPool pool(4);
+    std::vector<Diagram> diagrams;
+    Eigen::VectorXd labels;
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    if (!check(parseDiagramCsv(path, pool, diagrams, labels, errors, stats), "large file opens")) {
+        return false;
+    }
+
+    bool ordered = true;
+    size_t row = 0;
+    size_t expectedErrors = 0;
+    for (int i = 1; i <= LARGE_FILE_LINES; ++i) {
+        if (i % MALFORMED_EVERY == 0) {
+            ordered &= expectedErrors < errors.size() && errors[expectedErrors].line == static_cast<size_t>(i);
+            ++expectedErrors;
+            continue;
+        }
+        ordered &= row < diagrams.size() && diagrams[row].wireCount == 2 && diagrams[row].wires[0].position == i % GRID_SIZE
+                   && diagrams[row].wires[1].position == i / GRID_SIZE % GRID_SIZE && labels(row) == (i % 3 == 0 ? 1.0 : 0.0);
+        ++row;
+    }
+    bool passed = check(row == diagrams.size() && stats.rows == row, "large file row count");
+    passed &= check(expectedErrors == errors.size(), "large file error count");
+    passed &= check(ordered, "large file rows in order, errors at their line numbers");
+    return passed;
+}
+
+}
+
+int main() {
+    bool passed = true;
+
+    Diagram diagram;
+    int label = -1;
+    std::string error;
+    passed &= check(parseDiagramLine("Row 13 Green, Column 1 Blue ,Row 20 Red,Dangerous\r", diagram, label, error)
+                        && label == 1 && diagram.wireCount == 3
+                        && diagram.wires[0].isRow == 1 && diagram.wires[0].position == 12 && diagram.wires[0].color == 2
+                        && diagram.wires[1].isRow == 0 && diagram.wires[1].position == 0 && diagram.wires[1].color == 4
+                        && diagram.wires[2].position == 19 && diagram.wires[2].color == 1,
+                    "valid line");
+    passed &= check(parseDiagramLine("Row 2 Red,Row 2 Blue,Safe", diagram, label, error) && label == 0
+                        && diagram.wireCount == 1 && diagram.wires[0].color == 4,
+                    "repainted line keeps the last wire");
+
+    passed &= rejected("Row 1 Red", "no label column");
+    passed &= rejected("Row 1 Red,Maybe", "unknown label");
+    passed &= rejected("Line 1 Red,Safe", "bad orientation");
+    passed &= rejected("Row 0 Red,Safe", "position below 1");
+    passed &= rejected("Row 21 Red,Safe", "position above GRID_SIZE");
+    passed &= rejected("Row 3x Red,Safe", "position with trailing text");
+    passed &= rejected("Row 1 Purple,Safe", "unknown color");
+    passed &= rejected("Row 1 Red,Row 2 Red,Row 3 Red,Row 4 Red,Row 5 Red,Safe", "too many wires");
+
+    passed &= check(parseDiagramWires("Row 1 Red,Column 2 Blue,Safe", diagram, error) && diagram.wireCount == 2, "wires with a label");
+    passed &= check(parseDiagramWires("Row 1 Red,Column 2 Blue", diagram, error) && diagram.wireCount == 2, "wires without a label");
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "diagram-csvparsertest";
+    std::filesystem::create_directories(directory);
+
+    // Blank lines count toward the line numbers but are neither rows nor errors
+    const std::string smallPath = (directory / "small.csv").string();
+    {
+        std::ofstream out(smallPath, std::ios::binary | std::ios::trunc);
+        out << "Row 1 Red,Safe\r\n\nRow 1 Red,Unknown\nColumn 4 Yellow,Dangerous\nRow 99 Red,Safe";
+    }
+    ThreadPool pool(2);
+    std::vector<Diagram> diagrams;
+    Eigen::VectorXd labels;
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    passed &= check(parseDiagramCsv(smallPath, pool, diagrams, labels, errors, stats) && diagrams.size() == 2
+                        && labels(0) == 0 && labels(1) == 1 && diagrams[1].wires[0].color == 3,
+                    "small file rows");
+    passed &= check(errors.size() == 2 && errors[0].line == 3 && errors[1].line == 5, "small file error lines");
+    passed &= check(!parseDiagramCsv((directory / "missing.csv").string(), pool, diagrams, labels, errors, stats), "missing file");
+
+    passed &= parsesLargeFile((directory / "large.csv").string());
+
+    std::filesystem::remove_all(directory);
+    return passed ? 0 : 1;
+}
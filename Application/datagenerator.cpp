@@ -1,101 +1,163 @@
-#include "DataGenerator.h"
+#include "datagenerator.h"
+#include "threadpool.h"
+#include "diagramsink.h"
 #include <algorithm>
-#include <fstream>
+#include <deque>
+#include <future>
 
-DataGenerator::DataGenerator() : gen(rd()) {}
+#define BULK_CHUNK_SIZE 16384
+
+// encodeColor values of Red, Blue, Yellow, Green in Color order
+static const uint8_t COLOR_CODES[4] = {1, 4, 3, 2};
+
+DataGenerator::DataGenerator() : gen(std::random_device{}()), current{0, false}, usedRows(0), usedColumns(0) {}
+
+DataGenerator::DataGenerator(std::seed_seq& seeds) : gen(seeds), current{0, false}, usedRows(0), usedColumns(0) {}
 
 int DataGenerator::randomInRange(int start, int end) {
     std::uniform_int_distribution<> dis(start, end);
     return dis(gen);
 }
 
-DataGenerator::Color DataGenerator::getRandomColor(std::set<Color>& excludedColors) {
-    std::vector<Color> colors = {Color::Red, Color::Blue, Color::Yellow, Color::Green};
-    colors.erase(std::remove_if(colors.begin(), colors.end(),
-                                [&excludedColors](const Color& color) { return excludedColors.count(color) > 0; }),
-                 colors.end());
-    return colors[randomInRange(0, colors.size() - 1)];
-}
-
-std::string DataGenerator::colorToString(Color color) {
-    switch(color) {
-    case Color::Red: return "Red";
-    case Color::Blue: return "Blue";
-    case Color::Yellow: return "Yellow";
-    case Color::Green: return "Green";
-    default: return "Unknown";
+DataGenerator::Color DataGenerator::getRandomColor(uint32_t excludedColors) {
+    // Same candidate order and draw as before, so a seed still yields the same diagrams
+    Color colors[4];
+    int available = 0;
+    for (Color color : {Color::Red, Color::Blue, Color::Yellow, Color::Green}) {
+        if (!(excludedColors & (1u << static_cast<int>(color)))) {
+            colors[available++] = color;
+        }
     }
+    return colors[randomInRange(0, available - 1)];
 }
 
-std::string DataGenerator::generateDiagram() {
-    wireSequence.clear();
-    usedRows.clear();
-    usedColumns.clear();
-    Color diagram[20][20] = {}; // 2D array to represent the diagram
+DataGenerator::PackedDiagram DataGenerator::generateDiagram() {
+    current = {0, false};
+    usedRows = 0;
+    usedColumns = 0;
 
     bool startWithRow = randomInRange(0, 1); // 0 for row, 1 for column
-    std::set<Color> usedColors;
-    int selectedPosition;
-    Color selectedColor;
+    uint32_t usedColors = 0;
 
     // Generate wire placements
     for (int i = 0; i < 4; ++i) {
         bool isRow = (i % 2 == 0) ? startWithRow : !startWithRow;
-        colorRowOrColumn(isRow, selectedColor, selectedPosition, usedColors, diagram);
+        colorRowOrColumn(i, isRow, usedColors);
     }
 
     // Determine 'Dangerous' or 'Safe'
     bool redBeforeYellow = false;
-    for (const auto& wire : wireSequence) {
-        if (wire.color == "Red") {
+    for (int i = 0; i < 4; ++i) {
+        Color color = static_cast<Color>((current.wires >> (8 * i)) & 0x3);
+        if (color == Color::Red) {
             redBeforeYellow = true;
-        } else if (wire.color == "Yellow" && redBeforeYellow) {
-            status = "Dangerous";
-            return status;
+        } else if (color == Color::Yellow && redBeforeYellow) {
+            current.dangerous = true;
+            break;
         }
     }
-    status = "Safe";
-    return status;
+    return current;
 }
 
-
-
-void DataGenerator::colorRowOrColumn(bool isRow, Color& selectedColor, int& selectedPosition, std::set<Color>& usedColors, Color diagram[20][20]) {
+void DataGenerator::colorRowOrColumn(int wire, bool isRow, uint32_t& usedColors) {
+    uint32_t& used = isRow ? usedRows : usedColumns;
+    int selectedPosition;
     do {
         selectedPosition = randomInRange(1, 20) - 1;
-    } while (isRow ? usedRows.count(selectedPosition) > 0 : usedColumns.count(selectedPosition) > 0);
+    } while (used & (1u << selectedPosition));
+    used |= 1u << selectedPosition;
 
-    selectedColor = getRandomColor(usedColors);
-    usedColors.insert(selectedColor);
+    Color selectedColor = getRandomColor(usedColors);
+    usedColors |= 1u << static_cast<int>(selectedColor);
 
-    if (isRow) {
-        // Color the row
-        for (int i = 0; i < 20; ++i) {
-            diagram[selectedPosition][i] = selectedColor;
-        }
-        wireSequence.push_back({"Row", selectedPosition + 1, colorToString(selectedColor)});
-        usedRows.insert(selectedPosition);
-    } else {
-        // Color the column
-        for (int i = 0; i < 20; ++i) {
-            diagram[i][selectedPosition] = selectedColor;
-        }
-        wireSequence.push_back({"Column", selectedPosition + 1, colorToString(selectedColor)});
-        usedColumns.insert(selectedPosition);
+    uint32_t packed = (isRow ? 0x80u : 0u) | (static_cast<uint32_t>(selectedPosition) << 2) | static_cast<uint32_t>(selectedColor);
+    current.wires |= packed << (8 * wire);
+}
+
+Diagram DataGenerator::PackedDiagram::unpack() const {
+    Diagram result;
+    for (int i = 0; i < 4; ++i) {
+        uint32_t packed = (wires >> (8 * i)) & 0xFF;
+        result.addWire(packed & 0x80, (packed >> 2) & 0x1F, COLOR_CODES[packed & 0x3]);
     }
+    return result;
+}
+
+Diagram DataGenerator::diagram() const {
+    return current.unpack();
 }
 
-void DataGenerator::saveToCSV(const std::string& filename) {
-    std::ofstream file(filename, std::ios::app); // Open in append mode
-    if (file.is_open()) {
-        for (const auto& wire : wireSequence) {
-            file << wire.orientation << " " << wire.position << " " << wire.color;
-            if (&wire != &wireSequence.back()) {
-                file << ",";  // Add comma separator except after the last item
-            }
+int DataGenerator::label() const {
+    return current.dangerous ? 1 : 0;
+}
+
+void DataGenerator::writeTo(DiagramSink& sink) const {
+    Diagram record = diagram();
+    uint8_t recordLabel = static_cast<uint8_t>(label());
+    sink.write(&record, &recordLabel, 1);
+}
+
+namespace {
+
+using GeneratedChunk = std::vector<DataGenerator::PackedDiagram>;
+
+}
+
+void DataGenerator::generateBulk(size_t count, uint32_t masterSeed, ThreadPool& pool, DiagramSink& sink,
+                                 const ProgressCallback& onProgress) {
+    const size_t chunkCount = (count + BULK_CHUNK_SIZE - 1) / BULK_CHUNK_SIZE;
+
+    auto generateChunk = [count, masterSeed](size_t chunk) {
+        uint64_t index = chunk;
+        std::seed_seq seeds{masterSeed, static_cast<uint32_t>(index), static_cast<uint32_t>(index >> 32)};
+        DataGenerator generator(seeds);
+
+        size_t first = chunk * BULK_CHUNK_SIZE;
+        size_t last = std::min(count, first + BULK_CHUNK_SIZE);
+        GeneratedChunk result(last - first);
+        for (size_t i = first; i < last; ++i) {
+            result[i - first] = generator.generateDiagram();
         }
-        file << "," << status << "\n";  // Add status and end the line
+        return result;
+    };
+
+    // Keep a bounded window of chunks in flight and hand them to the sink strictly in order
+    const size_t window = pool.size() * 2;
+    std::deque<std::future<GeneratedChunk>> pending;
+    size_t submitted = 0;
+    size_t generated = 0;
+
+    while (submitted < chunkCount && pending.size() < window) {
+        pending.push_back(pool.submit([generateChunk, submitted]() { return generateChunk(submitted); }));
+        ++submitted;
     }
-}
 
+    // Chunks stay packed until they reach the sink; these buffers are reused for every chunk
+    std::vector<Diagram> diagrams;
+    std::vector<uint8_t> labels;
 
+    bool keepGoing = true;
+    while (!pending.empty()) {
+        GeneratedChunk chunk = pending.front().get();
+        pending.pop_front();
+        if (!keepGoing) {
+            continue; // drain what is already running
+        }
+
+        diagrams.resize(chunk.size());
+        labels.resize(chunk.size());
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            diagrams[i] = chunk[i].unpack();
+            labels[i] = chunk[i].dangerous;
+        }
+        sink.write(diagrams.data(), labels.data(), chunk.size());
+        generated += chunk.size();
+        keepGoing = !onProgress || onProgress(generated);
+
+        if (keepGoing && submitted < chunkCount) {
+            pending.push_back(pool.submit([generateChunk, submitted]() { return generateChunk(submitted); }));
+            ++submitted;
+        }
+    }
+    sink.flush();
+}
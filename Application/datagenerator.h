@@ -1,40 +1,55 @@
 #ifndef DATAGENERATOR_H
 #define DATAGENERATOR_H
 
-#include <set>
 #include <random>
 #include <string>
-#include <tuple>
-#include <vector>
+#include <functional>
+#include <cstdint>
+#include "diagram.h"
+
+class ThreadPool;
+class DiagramSink;
 
 class DataGenerator {
 public:
-    DataGenerator();
-    std::string generateDiagram();
-    void saveToCSV(const std::string& filename);
-
-private:
-    enum class Color {
+    enum class Color : uint8_t {
         Red, Blue, Yellow, Green
     };
 
-    struct WireInfo {
-        std::string orientation; // "Row" or "Column"
-        int position; // 1-20
-        std::string color; // "Red", "Blue", "Yellow", "Green"
+    // A generated diagram in a few bytes. Wire k lives in byte k of wires:
+    // bit 7 row flag, bits 2-6 the 0-based position, bits 0-1 the Color.
+    struct PackedDiagram {
+        uint32_t wires;
+        bool dangerous;
+
+        Diagram unpack() const;
     };
 
-    std::random_device rd;
+    DataGenerator();
+    explicit DataGenerator(std::seed_seq& seeds);
+    PackedDiagram generateDiagram();        // touches no heap memory
+    void writeTo(DiagramSink& sink) const;  // the last generated diagram
+    Diagram diagram() const;
+    int label() const;
+
+    // Called on the calling thread after each chunk reaches the sink; returning false stops generation.
+    using ProgressCallback = std::function<bool(size_t generated)>;
+
+    // Generates count diagrams on the pool in fixed-size chunks and writes them to sink in order.
+    // Chunk k draws from its own generator seeded with (masterSeed, k), so the output depends only
+    // on masterSeed and count, never on the thread count.
+    static void generateBulk(size_t count, uint32_t masterSeed, ThreadPool& pool, DiagramSink& sink,
+                             const ProgressCallback& onProgress = nullptr);
+
+private:
     std::mt19937 gen;
-    std::vector<WireInfo> wireSequence;
-    std::string status;
-    std::set<int> usedRows;
-    std::set<int> usedColumns;
+    PackedDiagram current;
+    uint32_t usedRows;    // bit i set once row i holds a wire
+    uint32_t usedColumns;
 
     int randomInRange(int start, int end);
-    Color getRandomColor(std::set<Color>& excludedColors);
-    std::string colorToString(Color color);
-    void colorRowOrColumn(bool isRow, Color& selectedColor, int& selectedPosition, std::set<Color>& usedColors, Color diagram[20][20]);
+    Color getRandomColor(uint32_t excludedColors);
+    void colorRowOrColumn(int wire, bool isRow, uint32_t& usedColors);
 };
 
 #endif // DATAGENERATOR_H
@@ -0,0 +1,147 @@
+#include "datasetcache.h"
+#include "mappedfile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'D', 'I', 'A', 'G', 'R', 'A', 'M', 'S'};
+const uint32_t CACHE_VERSION = 2;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t count;
+    uint64_t csvSize;
+    int64_t csvModified;
+};
+
+static_assert(std::is_trivially_copyable<DiagramRecord>::value, "Diagram records are written as raw bytes");
+
+// Size and modification time of the CSV, which decide whether a cache still describes it
+bool csvStamp(const std::string& csvPath, uint64_t& size, int64_t& modified) {
+    std::error_code error;
+    auto fileSize = std::filesystem::file_size(csvPath, error);
+    if (error) {
+        return false;
+    }
+    auto writeTime = std::filesystem::last_write_time(csvPath, error);
+    if (error) {
+        return false;
+    }
+    size = fileSize;
+    modified = static_cast<int64_t>(writeTime.time_since_epoch().count());
+    return true;
+}
+
+bool readRecords(const std::string& path, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels,
+                 bool checkStamp, uint64_t csvSize, int64_t csvModified) {
+    MappedFile file(path);
+    if (!file.isOpen() || file.size() < sizeof(CacheHeader)) {
+        return false;
+    }
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    // count comes from the file, so it is bounded by the bytes present before it is multiplied by anything
+    const uint64_t recordBytes = file.size() - sizeof(CacheHeader);
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION
+        || header.recordSize != sizeof(DiagramRecord) || header.count > recordBytes / sizeof(DiagramRecord)
+        || recordBytes != header.count * sizeof(DiagramRecord)) {
+        return false;
+    }
+    if (checkStamp && (header.csvSize != csvSize || header.csvModified != csvModified)) {
+        return false;
+    }
+
+    // Records are copied one at a time: the mapping gives no alignment guarantee past the header, and each
+    // record is split into a diagram and a label anyway
+    const char* records = file.data() + sizeof(CacheHeader);
+    diagrams.resize(header.count);
+    labels.resize(header.count);
+    for (uint64_t i = 0; i < header.count; ++i) {
+        DiagramRecord record;
+        std::memcpy(&record, records + i * sizeof(DiagramRecord), sizeof(record));
+        diagrams[i] = record.diagram;
+        labels(i) = record.label;
+    }
+    return true;
+}
+
+}
+
+std::string datasetCachePath(const std::string& csvPath) {
+    return csvPath + ".bin";
+}
+
+void writeDiagramFileHeader(std::ostream& out, uint64_t count, uint64_t csvSize, int64_t csvModified) {
+    CacheHeader header = {};
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.recordSize = sizeof(DiagramRecord);
+    header.count = count;
+    header.csvSize = csvSize;
+    header.csvModified = csvModified;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+size_t diagramFileHeaderSize() {
+    return sizeof(CacheHeader);
+}
+
+bool readDiagramFile(const std::string& path, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels) {
+    return readRecords(path, diagrams, labels, false, 0, 0);
+}
+
+bool readDatasetCache(const std::string& csvPath, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels) {
+    uint64_t csvSize;
+    int64_t csvModified;
+    if (!csvStamp(csvPath, csvSize, csvModified)) {
+        return false;
+    }
+    return readRecords(datasetCachePath(csvPath), diagrams, labels, true, csvSize, csvModified);
+}
+
+bool writeDatasetCache(const std::string& csvPath, const std::vector<Diagram>& diagrams, const Eigen::VectorXd& labels) {
+    uint64_t csvSize;
+    int64_t csvModified;
+    if (!csvStamp(csvPath, csvSize, csvModified)) {
+        return false;
+    }
+
+    std::string cachePath = datasetCachePath(csvPath);
+    std::string tempPath = cachePath + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            std::cerr << "Error: could not write dataset cache " << tempPath << std::endl;
+            return false;
+        }
+
+        std::vector<DiagramRecord> records(diagrams.size());
+        for (size_t i = 0; i < diagrams.size(); ++i) {
+            records[i] = {diagrams[i], static_cast<uint8_t>(labels(i))};
+        }
+
+        writeDiagramFileHeader(file, records.size(), csvSize, csvModified);
+        file.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(DiagramRecord));
+        file.close();
+        if (!file) {
+            std::cerr << "Error: could not write dataset cache " << tempPath << std::endl;
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef DATASETCACHE_H
+#define DATASETCACHE_H
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "diagram.h"
+
+// Binary diagram dataset file:
+//   header (magic, format version, record size, row count, size and mtime of the source CSV)
+//   count DiagramRecords.
+// Written by BinarySink (source stamp zero) and as a parse cache "<csv>.bin" next to a CSV, in which case
+// it is only used while the CSV still has the recorded size and modification time.
+
+struct DiagramRecord {
+    Diagram diagram;
+    uint8_t label;
+};
+
+std::string datasetCachePath(const std::string& csvPath);
+
+// Header for count records; offset 0 of the file. csvSize/csvModified are 0 when there is no source CSV.
+void writeDiagramFileHeader(std::ostream& out, uint64_t count, uint64_t csvSize = 0, int64_t csvModified = 0);
+size_t diagramFileHeaderSize();
+
+// Maps a binary dataset and copies its rows out. Returns false if it is missing or malformed.
+bool readDiagramFile(const std::string& path, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels);
+
+// Same for the cache of a CSV; also false if the cache is stale.
+bool readDatasetCache(const std::string& csvPath, std::vector<Diagram>& diagrams, Eigen::VectorXd& labels);
+
+// Writes the cache through a temporary file, so a crash never leaves a half-written cache behind.
+bool writeDatasetCache(const std::string& csvPath, const std::vector<Diagram>& diagrams, const Eigen::VectorXd& labels);
+
+#endif // DATASETCACHE_H
@@ -0,0 +1,111 @@
+// Dataset cache: rows written for a CSV read back unchanged, and a cache that is stale, truncated, of another
+// version or with a corrupt row count is rejected rather than trusted. A write that fails leaves no temporary file.
+#include "datasetcache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace {
+
+#define HEADER_VERSION_OFFSET 8
+#define HEADER_COUNT_OFFSET 16
+
+bool check(bool condition, const std::string& name) {
+    std::cout << (condition ? "ok   " : "FAIL ") << name << std::endl;
+    return condition;
+}
+
+std::string readBytes(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeBytes(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+bool sameRows(const std::vector<Diagram>& a, const Eigen::VectorXd& aLabels, const std::vector<Diagram>& b, const Eigen::VectorXd& bLabels) {
+    if (a.size() != b.size() || aLabels != bLabels) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].wireCount != b[i].wireCount) {
+            return false;
+        }
+        for (int k = 0; k < a[i].wireCount; ++k) {
+            const Wire& x = a[i].wires[k];
+            const Wire& y = b[i].wires[k];
+            if (x.isRow != y.isRow || x.position != y.position || x.color != y.color) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Reads path as a binary dataset after edit has been applied to a copy of the good cache
+template <typename Edit>
+bool rejects(const std::string& good, const std::string& path, Edit edit) {
+    std::string bytes = good;
+    edit(bytes);
+    writeBytes(path, bytes);
+    std::vector<Diagram> diagrams;
+    Eigen::VectorXd labels;
+    return !readDiagramFile(path, diagrams, labels);
+}
+
+}
+
+int main() {
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "diagram-datasetcachetest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string csvPath = (directory / "data.csv").string();
+    const std::string cachePath = datasetCachePath(csvPath);
+    writeBytes(csvPath, "Row 1 Red,Column 2 Blue,Safe\n");
+
+    std::vector<Diagram> diagrams(3);
+    diagrams[0].addWire(true, 0, 1);
+    diagrams[0].addWire(false, 1, 4);
+    diagrams[1].addWire(false, GRID_SIZE - 1, 2);
+    Eigen::VectorXd labels(3);
+    labels << 0, 1, 1;
+
+    bool passed = check(writeDatasetCache(csvPath, diagrams, labels), "write");
+    passed &= check(!std::filesystem::exists(cachePath + ".tmp"), "no temporary file after a write");
+    std::vector<Diagram> readDiagrams;
+    Eigen::VectorXd readLabels;
+    passed &= check(readDatasetCache(csvPath, readDiagrams, readLabels) && sameRows(diagrams, labels, readDiagrams, readLabels),
+                    "round trip");
+
+    const std::string good = readBytes(cachePath);
+    const std::string edited = (directory / "edited.bin").string();
+    passed &= check(rejects(good, edited, [](std::string& bytes) { bytes.pop_back(); }), "truncated record rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { bytes.resize(diagramFileHeaderSize() - 1); }), "truncated header rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { bytes[0] = 'X'; }), "bad magic rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { ++bytes[HEADER_VERSION_OFFSET]; }), "other version rejected");
+    // count + 2^63 times an even record size wraps to the same byte count, so only a bounded check catches it
+    passed &= check(rejects(good, edited, [](std::string& bytes) {
+        uint64_t count;
+        std::memcpy(&count, bytes.data() + HEADER_COUNT_OFFSET, sizeof(count));
+        count += uint64_t(1) << 63;
+        std::memcpy(&bytes[HEADER_COUNT_OFFSET], &count, sizeof(count));
+    }), "overflowing count rejected");
+
+    // Any change to the CSV makes its cache stale
+    writeBytes(csvPath, "Row 1 Red,Column 2 Blue,Safe\nRow 3 Green,Dangerous\n");
+    passed &= check(!readDatasetCache(csvPath, readDiagrams, readLabels), "stale cache rejected");
+
+    // A directory in the cache's place makes the final rename fail
+    std::filesystem::remove(cachePath);
+    std::filesystem::create_directories(std::filesystem::path(cachePath) / "occupied");
+    passed &= check(!writeDatasetCache(csvPath, diagrams, labels), "write over a directory fails");
+    passed &= check(!std::filesystem::exists(cachePath + ".tmp"), "no temporary file after a failed write");
+
+    std::filesystem::remove_all(directory);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+#include "designmatrix.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <numeric>
+
+#define PARALLEL_BLOCK_ROWS 32768 // fixed, so the reduction order never depends on the thread count
+#define GRAM_BLOCK_ROWS 256 // rows gathered per block of the dense row-subset Gram matrix
+
+void DesignMatrix::multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    thread_local std::vector<int> rows;
+    rows.resize(count);
+    std::iota(rows.begin(), rows.end(), static_cast<int>(begin));
+    multiplyRows(rows.data(), count, w, z);
+}
+
+void DesignMatrix::transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    thread_local std::vector<int> rows;
+    rows.resize(count);
+    std::iota(rows.begin(), rows.end(), static_cast<int>(begin));
+    transposeMultiplyRows(rows.data(), count, r, g);
+}
+
+// X is column-major, so both gathers walk it one column at a time; with ascending rows (as in the
+// train/test views) each column is read front to back instead of striding across all columns per row
+
+void DenseDesign::multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    z.head(count).setZero();
+    Eigen::Index j = 0;
+    // Four columns per pass, so z is read and written a quarter as often
+    for (; j + 4 <= X.cols(); j += 4) {
+        const double* c0 = X.col(j).data();
+        const double* c1 = X.col(j + 1).data();
+        const double* c2 = X.col(j + 2).data();
+        const double* c3 = X.col(j + 3).data();
+        const double w0 = w(j), w1 = w(j + 1), w2 = w(j + 2), w3 = w(j + 3);
+        for (Eigen::Index i = 0; i < count; ++i) {
+            const int row = rows[i];
+            z(i) += c0[row] * w0 + c1[row] * w1 + c2[row] * w2 + c3[row] * w3;
+        }
+    }
+    for (; j < X.cols(); ++j) {
+        const double* column = X.col(j).data();
+        const double weight = w(j);
+        for (Eigen::Index i = 0; i < count; ++i) {
+            z(i) += column[rows[i]] * weight;
+        }
+    }
+}
+
+void DenseDesign::transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    g.resize(X.cols());
+    Eigen::Index j = 0;
+    for (; j + 4 <= X.cols(); j += 4) {
+        const double* c0 = X.col(j).data();
+        const double* c1 = X.col(j + 1).data();
+        const double* c2 = X.col(j + 2).data();
+        const double* c3 = X.col(j + 3).data();
+        double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+        for (Eigen::Index i = 0; i < count; ++i) {
+            const int row = rows[i];
+            const double residual = r(i);
+            s0 += residual * c0[row];
+            s1 += residual * c1[row];
+            s2 += residual * c2[row];
+            s3 += residual * c3[row];
+        }
+        g(j) = s0;
+        g(j + 1) = s1;
+        g(j + 2) = s2;
+        g(j + 3) = s3;
+    }
+    for (; j < X.cols(); ++j) {
+        const double* column = X.col(j).data();
+        double sum = 0.0;
+        for (Eigen::Index i = 0; i < count; ++i) {
+            sum += r(i) * column[rows[i]];
+        }
+        g(j) = sum;
+    }
+}
+
+void DenseDesign::weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const {
+    // Gather a block of rows at a time into per-thread buffers, scaled and unscaled, and let Eigen form the block's
+    // contribution; after the first call the buffers are reused
+    thread_local Eigen::MatrixXd block;
+    thread_local Eigen::MatrixXd scaled;
+    H.setZero(X.cols(), X.cols());
+    for (Eigen::Index start = 0; start < count; start += GRAM_BLOCK_ROWS) {
+        const Eigen::Index blockRows = std::min<Eigen::Index>(GRAM_BLOCK_ROWS, count - start);
+        block.resize(blockRows, X.cols());
+        for (Eigen::Index j = 0; j < X.cols(); ++j) {
+            const double* column = X.col(j).data();
+            for (Eigen::Index i = 0; i < blockRows; ++i) {
+                block(i, j) = column[rows[start + i]];
+            }
+        }
+        scaled.noalias() = s.segment(start, blockRows).asDiagonal() * block;
+        H.noalias() += block.transpose() * scaled;
+    }
+}
+
+void RowSubsetDesign::multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const {
+    z.resize(rows());
+    base.multiplyRows(subset.data(), rows(), w, z);
+}
+
+void RowSubsetDesign::transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const {
+    base.transposeMultiplyRows(subset.data(), rows(), r, g);
+}
+
+const int* RowSubsetDesign::baseRows(const int* rows, Eigen::Index count) const {
+    // Rows of the view translated to rows of base, in a per-thread buffer that is reused between calls
+    thread_local std::vector<int> translated;
+    translated.resize(count);
+    for (Eigen::Index i = 0; i < count; ++i) {
+        translated[i] = subset[rows[i]];
+    }
+    return translated.data();
+}
+
+void RowSubsetDesign::multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    base.multiplyRows(baseRows(rows, count), count, w, z);
+}
+
+void RowSubsetDesign::transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    base.transposeMultiplyRows(baseRows(rows, count), count, r, g);
+}
+
+void RowSubsetDesign::multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    base.multiplyRows(subset.data() + begin, count, w, z);
+}
+
+void RowSubsetDesign::transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    base.transposeMultiplyRows(subset.data() + begin, count, r, g);
+}
+
+void RowSubsetDesign::weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const {
+    base.weightedGramRows(subset.data(), rows(), s, H);
+}
+
+void RowSubsetDesign::weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const {
+    base.weightedGramRows(baseRows(rows, count), count, s, H);
+}
+
+template <typename Block>
+void ParallelDesign::forEachBlock(Block block) const {
+    const Eigen::Index blocks = (rows() + PARALLEL_BLOCK_ROWS - 1) / PARALLEL_BLOCK_ROWS;
+    auto run = [this, &block](size_t b) {
+        const Eigen::Index begin = static_cast<Eigen::Index>(b) * PARALLEL_BLOCK_ROWS;
+        block(static_cast<Eigen::Index>(b), begin, std::min<Eigen::Index>(PARALLEL_BLOCK_ROWS, rows() - begin));
+    };
+    if (blocks <= 1 || pool.size() <= 1 || pool.isWorkerThread()) {
+        for (Eigen::Index b = 0; b < blocks; ++b) {
+            run(b);
+        }
+        return;
+    }
+    pool.forEachIndex(blocks, run);
+}
+
+void ParallelDesign::multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const {
+    // Every block writes its own slice of z, so there is nothing to combine
+    z.resize(rows());
+    forEachBlock([&](Eigen::Index, Eigen::Index begin, Eigen::Index count) {
+        base.multiplyRange(begin, count, w, z.segment(begin, count));
+    });
+}
+
+void ParallelDesign::transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const {
+    const Eigen::Index blocks = (rows() + PARALLEL_BLOCK_ROWS - 1) / PARALLEL_BLOCK_ROWS;
+    if (blocks == 0) {
+        g.setZero(cols());
+        return;
+    }
+
+    // Sized on the first call; the partials keep their storage for every later one
+    partials.resize(blocks - 1);
+    auto partial = [&](Eigen::Index b) -> Eigen::VectorXd& { return b == 0 ? g : partials[b - 1]; };
+    forEachBlock([&](Eigen::Index b, Eigen::Index begin, Eigen::Index count) {
+        base.transposeMultiplyRange(begin, count, r.segment(begin, count), partial(b));
+    });
+
+    // Pairwise tree over the block index: ((p0 + p1) + (p2 + p3)) + ..., which ends in g
+    for (Eigen::Index stride = 1; stride < blocks; stride *= 2) {
+        for (Eigen::Index b = 0; b + stride < blocks; b += 2 * stride) {
+            partial(b) += partial(b + stride);
+        }
+    }
+}
@@ -0,0 +1,155 @@
+#ifndef DESIGNMATRIX_H
+#define DESIGNMATRIX_H
+
+#include <Eigen/Dense>
+#include <vector>
+#include "diagram.h"
+
+class ThreadPool;
+
+// The two products gradient descent needs, independent of how the samples are stored
+class DesignMatrix {
+public:
+    virtual ~DesignMatrix() = default;
+
+    virtual Eigen::Index rows() const = 0;
+    virtual Eigen::Index cols() const = 0;
+    virtual void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const = 0;          // z = X * w
+    virtual void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const = 0; // g = X^T * r
+
+    // Same products over the listed rows only (a mini-batch); z and r have one entry per listed row
+    virtual void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const = 0;
+    virtual void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const = 0;
+
+    // Same products over the contiguous rows [begin, begin + count), the unit of work of ParallelDesign.
+    // The defaults go through the row-list variants; storages with a faster contiguous path override them.
+    virtual void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const;
+    virtual void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const;
+
+    // H = X^T * diag(s) * X, the Hessian shape needed by Newton/IRLS
+    virtual void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const = 0;
+    // Same over the listed rows only; s has one entry per listed row
+    virtual void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const = 0;
+};
+
+class DenseDesign : public DesignMatrix {
+public:
+    explicit DenseDesign(const Eigen::MatrixXd& X) : X(X) {}
+
+    Eigen::Index rows() const override { return X.rows(); }
+    Eigen::Index cols() const override { return X.cols(); }
+    void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const override { z.noalias() = X * w; }
+    void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const override { g.noalias() = X.transpose() * r; }
+    void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override {
+        z.noalias() = X.middleRows(begin, count) * w;
+    }
+    void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override {
+        g.noalias() = X.middleRows(begin, count).transpose() * r;
+    }
+    void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const override { H.noalias() = X.transpose() * s.asDiagonal() * X; }
+    void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const override;
+
+private:
+    const Eigen::MatrixXd& X;
+};
+
+class DiagramDesign : public DesignMatrix {
+public:
+    explicit DiagramDesign(const std::vector<Diagram>& diagrams) : diagrams(diagrams) {}
+
+    Eigen::Index rows() const override { return static_cast<Eigen::Index>(diagrams.size()); }
+    Eigen::Index cols() const override { return DENSE_FEATURES; }
+    void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const override { diagramMultiply(diagrams, w, z); }
+    void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const override { diagramTransposeMultiply(diagrams, r, g); }
+    void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override {
+        diagramMultiply(diagrams, rows, count, w, z);
+    }
+    void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override {
+        diagramTransposeMultiply(diagrams, rows, count, r, g);
+    }
+    void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override {
+        diagramMultiply(diagrams.data() + begin, count, w, z);
+    }
+    void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override {
+        diagramTransposeMultiply(diagrams.data() + begin, count, r, g);
+    }
+    void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const override { diagramWeightedGram(diagrams, s, H); }
+    void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const override {
+        diagramWeightedGram(diagrams, rows, count, s, H);
+    }
+
+private:
+    const std::vector<Diagram>& diagrams;
+};
+
+// Some rows of another design, in the listed order, without copying any sample; used for the folds of
+// cross-validation. base must outlive the view.
+class RowSubsetDesign : public DesignMatrix {
+public:
+    RowSubsetDesign(const DesignMatrix& base, std::vector<int> rows) : base(base), subset(std::move(rows)) {}
+
+    Eigen::Index rows() const override { return static_cast<Eigen::Index>(subset.size()); }
+    Eigen::Index cols() const override { return base.cols(); }
+    void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const override;
+    void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const override;
+    void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const override;
+    void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const override;
+
+    const std::vector<int>& indices() const { return subset; }
+
+private:
+    const DesignMatrix& base;
+    std::vector<int> subset;
+
+    const int* baseRows(const int* rows, Eigen::Index count) const;
+};
+
+// Runs the full products of another design on a thread pool, in fixed blocks of PARALLEL_BLOCK_ROWS rows.
+// The partial X^T r of the blocks are summed in a fixed pairwise tree, so results are bit-identical from run
+// to run and for any thread count. Called from a worker of the same pool (e.g. inside a grid search task),
+// the same blocks run inline rather than waiting on workers that may all be waiting themselves.
+// The mini-batch products and the Gram matrix go straight to base. base and pool must outlive the view.
+// The view keeps its block buffers between calls, so after the first product it allocates nothing; it also
+// means one view serves one product at a time.
+class ParallelDesign : public DesignMatrix {
+public:
+    ParallelDesign(const DesignMatrix& base, ThreadPool& pool) : base(base), pool(pool) {}
+
+    Eigen::Index rows() const override { return base.rows(); }
+    Eigen::Index cols() const override { return base.cols(); }
+    void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const override;
+    void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const override;
+    void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override {
+        base.multiplyRows(rows, count, w, z);
+    }
+    void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override {
+        base.transposeMultiplyRows(rows, count, r, g);
+    }
+    void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override {
+        base.multiplyRange(begin, count, w, z);
+    }
+    void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override {
+        base.transposeMultiplyRange(begin, count, r, g);
+    }
+    void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const override { base.weightedGram(s, H); }
+    void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const override {
+        base.weightedGramRows(rows, count, s, H);
+    }
+
+private:
+    const DesignMatrix& base;
+    ThreadPool& pool;
+    // Gradients of blocks 1 and up, kept from one transposeMultiply to the next; block 0 sums into g itself
+    mutable std::vector<Eigen::VectorXd> partials;
+
+    template <typename Block>
+    void forEachBlock(Block block) const;
+};
+
+#endif // DESIGNMATRIX_H
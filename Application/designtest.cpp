@@ -0,0 +1,192 @@
+// Checks every design matrix against the dense matrix it stands for: random diagrams (crossings, repainted
+// lines, unknown colors) are expanded with denseFeatures or FeatureEncoder::encode, and each storage's full,
+// row-list, range and Gram products must match the DenseDesign ones within a tolerance.
+#include "designmatrix.h"
+#include "featureencoder.h"
+#include "quantizeddesign.h"
+#include "threadpool.h"
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace {
+
+#define SAMPLES 300
+#define PARALLEL_SAMPLES 70000 // more than two blocks of ParallelDesign
+#define EXACT_TOLERANCE 1e-9   // relative; designs that sum in double
+#define FLOAT_TOLERANCE 1e-5   // relative; quantized designs accumulate blocks in float
+
+std::vector<Diagram> randomDiagrams(std::mt19937& gen, size_t count) {
+    // Colors include 0 (unknown) and up to six wires are offered, so some repaint a line already laid
+    std::uniform_int_distribution<int> position(0, GRID_SIZE - 1), color(0, COLOR_COUNT), coin(0, 1), wires(0, WIRE_COUNT + 2);
+    std::vector<Diagram> diagrams(count);
+    for (Diagram& diagram : diagrams) {
+        for (int k = wires(gen); k > 0; --k) {
+            diagram.addWire(coin(gen) == 1, position(gen), color(gen));
+        }
+    }
+    return diagrams;
+}
+
+Eigen::MatrixXd denseMatrix(const std::vector<Diagram>& diagrams, const FeatureEncoder& encoder) {
+    Eigen::MatrixXd X(diagrams.size(), encoder.featureCount());
+    for (size_t i = 0; i < diagrams.size(); ++i) {
+        X.row(i) = encoder.encode(diagrams[i]);
+    }
+    return X;
+}
+
+bool close(const std::string& name, const char* product, const Eigen::MatrixXd& actual, const Eigen::MatrixXd& expected, double tolerance) {
+    if (actual.rows() != expected.rows() || actual.cols() != expected.cols()) {
+        std::cout << "FAIL " << name << " " << product << ": " << actual.rows() << "x" << actual.cols()
+                  << " instead of " << expected.rows() << "x" << expected.cols() << std::endl;
+        return false;
+    }
+    const double error = (actual - expected).cwiseAbs().maxCoeff();
+    const double scale = std::max(1.0, expected.cwiseAbs().maxCoeff());
+    if (error > tolerance * scale) {
+        std::cout << "FAIL " << name << " " << product << ": max error " << error << " at scale " << scale << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Compares every product of design with the same product of the dense matrix X
+bool matchesDense(const std::string& name, const DesignMatrix& design, const Eigen::MatrixXd& X, double tolerance, std::mt19937& gen) {
+    const DenseDesign dense(X);
+    const Eigen::VectorXd w = Eigen::VectorXd::Random(X.cols());
+    const Eigen::VectorXd r = Eigen::VectorXd::Random(X.rows());
+    const Eigen::VectorXd s = Eigen::VectorXd::Random(X.rows()).cwiseAbs();
+
+    // A mini-batch with repeated and unordered rows
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(X.rows()) - 1);
+    std::vector<int> batch(X.rows() / 3);
+    for (int& row : batch) {
+        row = pick(gen);
+    }
+    const Eigen::Index count = static_cast<Eigen::Index>(batch.size());
+    const Eigen::Index begin = X.rows() / 4, length = X.rows() / 2;
+
+    bool passed = design.rows() == X.rows() && design.cols() == X.cols();
+    if (!passed) {
+        std::cout << "FAIL " << name << ": shape " << design.rows() << "x" << design.cols() << std::endl;
+        return false;
+    }
+
+    Eigen::VectorXd actual, expected;
+    design.multiply(w, actual);
+    dense.multiply(w, expected);
+    passed &= close(name, "multiply", actual, expected, tolerance);
+    design.transposeMultiply(r, actual);
+    dense.transposeMultiply(r, expected);
+    passed &= close(name, "transposeMultiply", actual, expected, tolerance);
+
+    actual.resize(count);
+    expected.resize(count);
+    design.multiplyRows(batch.data(), count, w, actual);
+    dense.multiplyRows(batch.data(), count, w, expected);
+    passed &= close(name, "multiplyRows", actual, expected, tolerance);
+    design.transposeMultiplyRows(batch.data(), count, r.head(count), actual);
+    dense.transposeMultiplyRows(batch.data(), count, r.head(count), expected);
+    passed &= close(name, "transposeMultiplyRows", actual, expected, tolerance);
+
+    actual.resize(length);
+    expected.resize(length);
+    design.multiplyRange(begin, length, w, actual);
+    dense.multiplyRange(begin, length, w, expected);
+    passed &= close(name, "multiplyRange", actual, expected, tolerance);
+    design.transposeMultiplyRange(begin, length, r.segment(begin, length), actual);
+    dense.transposeMultiplyRange(begin, length, r.segment(begin, length), expected);
+    passed &= close(name, "transposeMultiplyRange", actual, expected, tolerance);
+
+    Eigen::MatrixXd gram, expectedGram;
+    design.weightedGram(s, gram);
+    dense.weightedGram(s, expectedGram);
+    passed &= close(name, "weightedGram", gram, expectedGram, tolerance);
+    // Against Eigen directly, since DenseDesign's own row-list Gram matrix is one of the implementations under test
+    Eigen::MatrixXd batchRows(count, X.cols());
+    for (Eigen::Index i = 0; i < count; ++i) {
+        batchRows.row(i) = X.row(batch[i]);
+    }
+    design.weightedGramRows(batch.data(), count, s.head(count), gram);
+    expectedGram = batchRows.transpose() * s.head(count).asDiagonal() * batchRows;
+    passed &= close(name, "weightedGramRows", gram, expectedGram, tolerance);
+
+    std::cout << (passed ? "ok   " : "FAIL ") << name << std::endl;
+    return passed;
+}
+
+template <typename Cell>
+std::unique_ptr<DesignMatrix> quantized(const Eigen::MatrixXd& X) {
+    auto design = std::make_unique<QuantizedDesign<Cell>>(X.rows(), X.cols());
+    for (Eigen::Index i = 0; i < X.rows(); ++i) {
+        design->setRow(i, X.row(i).transpose());
+    }
+    return design;
+}
+
+// The blocks of ParallelDesign against its base, on enough rows for several blocks and threads
+bool parallelMatchesBase(std::mt19937& gen) {
+    const std::vector<Diagram> diagrams = randomDiagrams(gen, PARALLEL_SAMPLES);
+    const DiagramDesign base(diagrams);
+    ThreadPool pool(3);
+    const ParallelDesign parallel(base, pool);
+    const Eigen::VectorXd w = Eigen::VectorXd::Random(base.cols());
+    const Eigen::VectorXd r = Eigen::VectorXd::Random(base.rows());
+
+    Eigen::VectorXd actual, expected;
+    parallel.multiply(w, actual);
+    base.multiply(w, expected);
+    bool passed = close("parallel", "multiply", actual, expected, EXACT_TOLERANCE);
+    parallel.transposeMultiply(r, actual);
+    base.transposeMultiply(r, expected);
+    passed &= close("parallel", "transposeMultiply", actual, expected, EXACT_TOLERANCE);
+
+    std::cout << (passed ? "ok   " : "FAIL ") << "parallel blocks" << std::endl;
+    return passed;
+}
+
+}
+
+int main() {
+    std::mt19937 gen(11);
+    const std::vector<Diagram> diagrams = randomDiagrams(gen, SAMPLES);
+    bool passed = true;
+
+    // The grid through the line-sum kernels, and through the storages every FeatureStorage builds
+    const Eigen::MatrixXd grid = denseMatrix(diagrams, featureEncoder(FeatureEncoding::Grid));
+    for (int i = 0; i < SAMPLES; ++i) {
+        passed &= close("denseFeatures", "row", denseFeatures(diagrams[i]), grid.row(i).transpose(), 0.0);
+    }
+    const DiagramDesign diagramDesign(diagrams);
+    passed &= matchesDense("diagram", diagramDesign, grid, EXACT_TOLERANCE, gen);
+    passed &= matchesDense("uint8", *quantized<uint8_t>(grid), grid, FLOAT_TOLERANCE, gen);
+    passed &= matchesDense("float32", *quantized<float>(grid), grid, FLOAT_TOLERANCE, gen);
+
+    ThreadPool pool(2);
+    passed &= matchesDense("parallel", ParallelDesign(diagramDesign, pool), grid, EXACT_TOLERANCE, gen);
+
+    // A view over every other row, in descending order, against the same rows of the dense matrix
+    std::vector<int> rows;
+    for (int i = SAMPLES - 1; i >= 0; i -= 2) {
+        rows.push_back(i);
+    }
+    Eigen::MatrixXd subsetGrid(rows.size(), grid.cols());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        subsetGrid.row(i) = grid.row(rows[i]);
+    }
+    passed &= matchesDense("subset of diagram", RowSubsetDesign(diagramDesign, rows), subsetGrid, EXACT_TOLERANCE, gen);
+    const DenseDesign denseDesign(grid);
+    passed &= matchesDense("subset of dense", RowSubsetDesign(denseDesign, rows), subsetGrid, EXACT_TOLERANCE, gen);
+
+    for (FeatureEncoding encoding : {FeatureEncoding::Grid, FeatureEncoding::WireSequence, FeatureEncoding::ColorOrder}) {
+        const FeatureEncoder& encoder = featureEncoder(encoding);
+        const Eigen::MatrixXd X = denseMatrix(diagrams, encoder);
+        passed &= matchesDense(std::string("encoded ") + encoder.name(), *encoder.design(diagrams), X, EXACT_TOLERANCE, gen);
+        passed &= matchesDense(std::string("encoded ") + encoder.name() + " as EncodedDesign", EncodedDesign(diagrams, encoder), X, EXACT_TOLERANCE, gen);
+    }
+
+    passed &= parallelMatchesBase(gen);
+    return passed ? 0 : 1;
+}
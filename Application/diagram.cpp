@@ -0,0 +1,217 @@
+#include "diagram.h"
+#include <algorithm>
+
+namespace {
+
+inline int cellIndex(const Wire& a, const Wire& b) {
+    // a and b have different orientations
+    const Wire& row = a.isRow ? a : b;
+    const Wire& col = a.isRow ? b : a;
+    return row.position * GRID_SIZE + col.position;
+}
+
+}
+
+bool Diagram::addWire(bool isRow, int position, int color) {
+    // Repainting a line hides the earlier wire completely, so only the latest one is kept
+    auto end = wires.begin() + wireCount;
+    auto same = std::find_if(wires.begin(), end, [&](const Wire& w) {
+        return w.isRow == isRow && w.position == position;
+    });
+    if (same != end) {
+        std::rotate(same, same + 1, end);
+        --wireCount;
+    }
+
+    if (wireCount == WIRE_COUNT || position < 0 || position >= GRID_SIZE) {
+        return false;
+    }
+    wires[wireCount++] = {static_cast<uint8_t>(isRow), static_cast<uint8_t>(position), static_cast<uint8_t>(color)};
+    return true;
+}
+
+int encodeColor(std::string_view color) {
+    if (color == "Red") return 1;
+    if (color == "Green") return 2;
+    if (color == "Yellow") return 3;
+    if (color == "Blue") return 4;
+    return 0;
+}
+
+const char* colorName(int value) {
+    switch (value) {
+    case 1: return "Red";
+    case 2: return "Green";
+    case 3: return "Yellow";
+    case 4: return "Blue";
+    default: return "Unknown";
+    }
+}
+
+Eigen::VectorXd denseFeatures(const Diagram& diagram) {
+    Eigen::VectorXd features = Eigen::VectorXd::Zero(DENSE_FEATURES);
+
+    for (int k = 0; k < diagram.wireCount; ++k) {
+        const Wire& wire = diagram.wires[k];
+        for (int i = 0; i < GRID_SIZE; ++i) {
+            int cell = wire.isRow ? wire.position * GRID_SIZE + i : i * GRID_SIZE + wire.position;
+            features(cell) = wire.color;
+        }
+    }
+    return features;
+}
+
+namespace {
+
+struct LineSums {
+    std::array<double, GRID_SIZE> rows = {};
+    std::array<double, GRID_SIZE> cols = {};
+};
+
+LineSums lineSums(const Eigen::VectorXd& w) {
+    LineSums sums;
+    for (int r = 0; r < GRID_SIZE; ++r) {
+        for (int c = 0; c < GRID_SIZE; ++c) {
+            double value = w(r * GRID_SIZE + c);
+            sums.rows[r] += value;
+            sums.cols[c] += value;
+        }
+    }
+    return sums;
+}
+
+inline double diagramDot(const Diagram& d, const Eigen::VectorXd& w, const LineSums& sums) {
+    double sum = 0.0;
+    for (int k = 0; k < d.wireCount; ++k) {
+        const Wire& wire = d.wires[k];
+        sum += wire.color * (wire.isRow ? sums.rows[wire.position] : sums.cols[wire.position]);
+
+        // The earlier wire's value at the crossing was painted over by this one
+        for (int j = 0; j < k; ++j) {
+            if (d.wires[j].isRow != wire.isRow) {
+                sum -= d.wires[j].color * w(cellIndex(d.wires[j], wire));
+            }
+        }
+    }
+    return sum;
+}
+
+inline void diagramScatter(const Diagram& d, double residual, Eigen::VectorXd& g, LineSums& totals) {
+    for (int k = 0; k < d.wireCount; ++k) {
+        const Wire& wire = d.wires[k];
+        (wire.isRow ? totals.rows[wire.position] : totals.cols[wire.position]) += residual * wire.color;
+
+        for (int j = 0; j < k; ++j) {
+            if (d.wires[j].isRow != wire.isRow) {
+                g(cellIndex(d.wires[j], wire)) -= residual * d.wires[j].color;
+            }
+        }
+    }
+}
+
+void expandLineTotals(const LineSums& totals, Eigen::VectorXd& g) {
+    for (int row = 0; row < GRID_SIZE; ++row) {
+        for (int col = 0; col < GRID_SIZE; ++col) {
+            g(row * GRID_SIZE + col) += totals.rows[row] + totals.cols[col];
+        }
+    }
+}
+
+}
+
+void diagramMultiply(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& w, Eigen::VectorXd& z) {
+    z.resize(diagrams.size());
+    diagramMultiply(diagrams.data(), z.size(), w, z);
+}
+
+void diagramMultiply(const Diagram* diagrams, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) {
+    LineSums sums = lineSums(w);
+    for (Eigen::Index i = 0; i < count; ++i) {
+        z(i) = diagramDot(diagrams[i], w, sums);
+    }
+}
+
+void diagramMultiply(const std::vector<Diagram>& diagrams, const int* rows, Eigen::Index count,
+                     const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) {
+    LineSums sums = lineSums(w);
+    for (Eigen::Index i = 0; i < count; ++i) {
+        z(i) = diagramDot(diagrams[rows[i]], w, sums);
+    }
+}
+
+void diagramTransposeMultiply(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& r, Eigen::VectorXd& g) {
+    diagramTransposeMultiply(diagrams.data(), static_cast<Eigen::Index>(diagrams.size()), r, g);
+}
+
+void diagramTransposeMultiply(const Diagram* diagrams, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) {
+    LineSums totals;
+    g.setZero(DENSE_FEATURES);
+    for (Eigen::Index i = 0; i < count; ++i) {
+        diagramScatter(diagrams[i], r(i), g, totals);
+    }
+    expandLineTotals(totals, g);
+}
+
+void diagramTransposeMultiply(const std::vector<Diagram>& diagrams, const int* rows, Eigen::Index count,
+                              const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) {
+    LineSums totals;
+    g.setZero(DENSE_FEATURES);
+    for (Eigen::Index i = 0; i < count; ++i) {
+        diagramScatter(diagrams[rows[i]], r(i), g, totals);
+    }
+    expandLineTotals(totals, g);
+}
+
+int diagramCells(const Diagram& d, int* index, double* value) {
+    // A crossing belongs to whichever wire was laid last
+    int cells = 0;
+    for (int k = 0; k < d.wireCount; ++k) {
+        const Wire& wire = d.wires[k];
+        for (int p = 0; p < GRID_SIZE; ++p) {
+            bool paintedOver = false;
+            for (int j = k + 1; j < d.wireCount; ++j) {
+                paintedOver |= d.wires[j].isRow != wire.isRow && d.wires[j].position == p;
+            }
+            if (!paintedOver && wire.color != 0) {
+                index[cells] = wire.isRow ? wire.position * GRID_SIZE + p : p * GRID_SIZE + wire.position;
+                value[cells++] = wire.color;
+            }
+        }
+    }
+    return cells;
+}
+
+namespace {
+
+// Sums weight * x x^T of every diagram into the lower triangle of H, then mirrors it
+template <typename DiagramAt, typename WeightAt>
+void accumulateWeightedGram(DiagramAt diagramAt, WeightAt weightAt, Eigen::Index count, Eigen::MatrixXd& H) {
+    std::array<int, MAX_DIAGRAM_CELLS> index;
+    std::array<double, MAX_DIAGRAM_CELLS> value;
+    H.setZero(DENSE_FEATURES, DENSE_FEATURES);
+
+    for (Eigen::Index i = 0; i < count; ++i) {
+        int cells = diagramCells(diagramAt(i), index.data(), value.data());
+        for (int a = 0; a < cells; ++a) {
+            double scaled = weightAt(i) * value[a];
+            for (int b = 0; b <= a; ++b) {
+                H(std::max(index[a], index[b]), std::min(index[a], index[b])) += scaled * value[b];
+            }
+        }
+    }
+
+    H.triangularView<Eigen::StrictlyUpper>() = H.transpose();
+}
+
+}
+
+void diagramWeightedGram(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& s, Eigen::MatrixXd& H) {
+    accumulateWeightedGram([&](Eigen::Index i) -> const Diagram& { return diagrams[i]; },
+                           [&](Eigen::Index i) { return s(i); }, static_cast<Eigen::Index>(diagrams.size()), H);
+}
+
+void diagramWeightedGram(const std::vector<Diagram>& diagrams, const int* rows, Eigen::Index count,
+                         const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) {
+    accumulateWeightedGram([&](Eigen::Index i) -> const Diagram& { return diagrams[rows[i]]; },
+                           [&](Eigen::Index i) { return s(i); }, count, H);
+}
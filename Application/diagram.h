@@ -0,0 +1,67 @@
+#ifndef DIAGRAM_H
+#define DIAGRAM_H
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#define GRID_SIZE 20
+#define WIRE_COUNT 4
+#define DENSE_FEATURES (GRID_SIZE * GRID_SIZE) // flattened grid; the intercept is a separate model parameter
+#define MAX_DIAGRAM_CELLS (WIRE_COUNT * GRID_SIZE) // nonzero cells of one dense row, at most
+#define FEATURE_ENCODING_VERSION 3 // bump whenever the meaning of a feature index changes; saved with models
+
+// One painted line of a diagram. position is 0-based, color is the encodeColor value.
+struct Wire {
+    uint8_t isRow;
+    uint8_t position;
+    uint8_t color;
+};
+
+// Compact form of a diagram: the wires in the order they were laid. A wire that repaints a line
+// already in the list replaces the earlier one, so every row and column appears at most once and
+// a cell is covered by at most one row wire and one column wire.
+struct Diagram {
+    std::array<Wire, WIRE_COUNT> wires = {};
+    uint8_t wireCount = 0;
+
+    bool addWire(bool isRow, int position, int color);
+};
+
+// Red 1, Green 2, Yellow 3, Blue 4, anything else 0
+int encodeColor(std::string_view color);
+// Inverse of encodeColor; "Unknown" for 0
+const char* colorName(int value);
+
+// Dense 400-wide feature row equivalent to the compact diagram
+Eigen::VectorXd denseFeatures(const Diagram& diagram);
+
+// Nonzero cells of the dense row as (index, value) pairs; index and value hold MAX_DIAGRAM_CELLS entries.
+// Returns the number of cells written.
+int diagramCells(const Diagram& diagram, int* index, double* value);
+
+// z = X * w for the dense design matrix implied by the diagrams, computed from line sums of w
+void diagramMultiply(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& w, Eigen::VectorXd& z);
+
+// g = X^T * r for the same implied matrix, scattered as per-line totals plus intersection corrections
+void diagramTransposeMultiply(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& r, Eigen::VectorXd& g);
+
+// Same products over a contiguous block of count diagrams that need not live in a vector
+void diagramMultiply(const Diagram* diagrams, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z);
+void diagramTransposeMultiply(const Diagram* diagrams, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g);
+
+// Row-subset variants: only diagrams[rows[0..count)] take part, z and r follow the order of rows
+void diagramMultiply(const std::vector<Diagram>& diagrams, const int* rows, Eigen::Index count,
+                     const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z);
+void diagramTransposeMultiply(const std::vector<Diagram>& diagrams, const int* rows, Eigen::Index count,
+                              const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g);
+
+// H = X^T * diag(s) * X, accumulated over the at most MAX_DIAGRAM_CELLS nonzero cells of each diagram
+void diagramWeightedGram(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& s, Eigen::MatrixXd& H);
+// Row-subset variant, s following the order of rows
+void diagramWeightedGram(const std::vector<Diagram>& diagrams, const int* rows, Eigen::Index count,
+                         const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H);
+
+#endif // DIAGRAM_H
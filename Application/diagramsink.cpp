@@ -0,0 +1,88 @@
+#include "diagramsink.h"
+#include <charconv>
+#include <cstring>
+
+CsvSink::CsvSink(const std::string& path, bool append, size_t bufferBytes)
+    : file(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc)), bufferLimit(bufferBytes) {
+    buffer.reserve(bufferBytes + 256);
+}
+
+CsvSink::~CsvSink() {
+    flush();
+}
+
+void CsvSink::write(const Diagram* diagrams, const uint8_t* labels, size_t count) {
+    char number[8];
+    for (size_t i = 0; i < count; ++i) {
+        const Diagram& d = diagrams[i];
+        for (int k = 0; k < d.wireCount; ++k) {
+            const Wire& wire = d.wires[k];
+            buffer += wire.isRow ? "Row " : "Column ";
+            char* end = std::to_chars(number, number + sizeof(number), wire.position + 1).ptr;
+            buffer.append(number, end);
+            buffer += ' ';
+            buffer += colorName(wire.color);
+            buffer += ',';
+        }
+        buffer += labels[i] ? "Dangerous\n" : "Safe\n";
+
+        if (buffer.size() >= bufferLimit) {
+            flush();
+        }
+    }
+}
+
+void CsvSink::flush() {
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    buffer.clear();
+}
+
+BinarySink::BinarySink(const std::string& path) : file(path, std::ios::binary | std::ios::trunc), count(0) {
+    writeDiagramFileHeader(file, 0);
+}
+
+BinarySink::~BinarySink() {
+    flush();
+}
+
+void BinarySink::write(const Diagram* diagrams, const uint8_t* labels, size_t rows) {
+    records.resize(rows);
+    for (size_t i = 0; i < rows; ++i) {
+        records[i] = {diagrams[i], labels[i]};
+    }
+    file.write(reinterpret_cast<const char*>(records.data()), rows * sizeof(DiagramRecord));
+    count += rows;
+}
+
+void BinarySink::flush() {
+    // Rewrite the header with the final row count, then return to the end for further writes
+    std::streampos end = file.tellp();
+    file.seekp(0);
+    writeDiagramFileHeader(file, count);
+    file.seekp(end);
+    file.flush();
+}
+
+void MemorySink::write(const Diagram* diagrams, const uint8_t* labels, size_t count) {
+    samples.insert(samples.end(), diagrams, diagrams + count);
+    sampleLabels.insert(sampleLabels.end(), labels, labels + count);
+}
+
+Eigen::VectorXd MemorySink::labels() const {
+    Eigen::VectorXd result(sampleLabels.size());
+    for (size_t i = 0; i < sampleLabels.size(); ++i) {
+        result(i) = sampleLabels[i];
+    }
+    return result;
+}
+
+void TeeSink::write(const Diagram* diagrams, const uint8_t* labels, size_t count) {
+    first.write(diagrams, labels, count);
+    second.write(diagrams, labels, count);
+}
+
+void TeeSink::flush() {
+    first.flush();
+    second.flush();
+}
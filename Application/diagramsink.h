@@ -0,0 +1,79 @@
+#ifndef DIAGRAMSINK_H
+#define DIAGRAMSINK_H
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "diagram.h"
+#include "datasetcache.h"
+
+// Destination for generated diagrams. Rows arrive in order, one chunk at a time.
+class DiagramSink {
+public:
+    virtual ~DiagramSink() = default;
+
+    virtual void write(const Diagram* diagrams, const uint8_t* labels, size_t count) = 0;
+    virtual void flush() {}
+};
+
+// CSV rows in the format parseDiagramLine reads, formatted into a large buffer and written in big blocks
+class CsvSink : public DiagramSink {
+public:
+    explicit CsvSink(const std::string& path, bool append = true, size_t bufferBytes = 1 << 22);
+    ~CsvSink() override;
+
+    bool isOpen() const { return file.is_open(); }
+    void write(const Diagram* diagrams, const uint8_t* labels, size_t count) override;
+    void flush() override;
+
+private:
+    std::ofstream file;
+    std::string buffer;
+    size_t bufferLimit;
+};
+
+// Binary dataset file (see datasetcache.h); the row count in the header is filled in by flush()
+class BinarySink : public DiagramSink {
+public:
+    explicit BinarySink(const std::string& path);
+    ~BinarySink() override;
+
+    bool isOpen() const { return file.is_open(); }
+    void write(const Diagram* diagrams, const uint8_t* labels, size_t count) override;
+    void flush() override;
+
+private:
+    std::ofstream file;
+    std::vector<DiagramRecord> records;
+    uint64_t count;
+};
+
+// Keeps the rows in memory, ready to be handed to MachineLearning::addSamples without a file round trip
+class MemorySink : public DiagramSink {
+public:
+    void write(const Diagram* diagrams, const uint8_t* labels, size_t count) override;
+
+    const std::vector<Diagram>& diagrams() const { return samples; }
+    Eigen::VectorXd labels() const;
+
+private:
+    std::vector<Diagram> samples;
+    std::vector<uint8_t> sampleLabels;
+};
+
+// Forwards every chunk to two sinks, e.g. a CSV for persistence and memory for training
+class TeeSink : public DiagramSink {
+public:
+    TeeSink(DiagramSink& first, DiagramSink& second) : first(first), second(second) {}
+
+    void write(const Diagram* diagrams, const uint8_t* labels, size_t count) override;
+    void flush() override;
+
+private:
+    DiagramSink& first;
+    DiagramSink& second;
+};
+
+#endif // DIAGRAMSINK_H
@@ -0,0 +1,70 @@
+#include "evaluation.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+ThresholdMetrics metricsAt(double threshold, double truePositives, double falsePositives, double positives, double negatives) {
+    double predicted = truePositives + falsePositives;
+    double total = positives + negatives;
+
+    ThresholdMetrics metrics;
+    metrics.threshold = threshold;
+    metrics.accuracy = total > 0 ? (truePositives + negatives - falsePositives) / total : 0.0;
+    metrics.precision = predicted > 0 ? truePositives / predicted : 1.0;
+    metrics.recall = positives > 0 ? truePositives / positives : 0.0;
+    double sum = metrics.precision + metrics.recall;
+    metrics.f1 = sum > 0 ? 2 * metrics.precision * metrics.recall / sum : 0.0;
+    metrics.falsePositiveRate = negatives > 0 ? falsePositives / negatives : 0.0;
+    return metrics;
+}
+
+}
+
+EvaluationReport evaluateProbabilities(const Eigen::VectorXd& probabilities, const Eigen::VectorXd& labels) {
+    const Eigen::Index n = probabilities.size();
+    EvaluationReport report;
+
+    // Highest probability first: lowering the cutoff past each score turns those samples positive
+    std::vector<Eigen::Index> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](Eigen::Index a, Eigen::Index b) { return probabilities(a) > probabilities(b); });
+
+    const double positives = labels.sum();
+    const double negatives = n - positives;
+    double truePositives = 0.0;
+    double falsePositives = 0.0;
+
+    // Nothing predicted positive
+    double top = n > 0 ? probabilities(order[0]) : 0.5;
+    report.curve.push_back(metricsAt(std::max(top, 1.0), 0.0, 0.0, positives, negatives));
+
+    for (Eigen::Index i = 0; i < n;) {
+        // Samples with equal scores cross every cutoff together
+        const double score = probabilities(order[i]);
+        for (; i < n && probabilities(order[i]) == score; ++i) {
+            if (labels(order[i]) > 0.5) {
+                truePositives += 1.0;
+            } else {
+                falsePositives += 1.0;
+            }
+        }
+
+        double threshold = i < n ? (score + probabilities(order[i])) / 2 : std::min(score, 0.0) - 1.0;
+        ThresholdMetrics point = metricsAt(threshold, truePositives, falsePositives, positives, negatives);
+        const ThresholdMetrics& previous = report.curve.back();
+
+        // Trapezoids for ROC, recall steps for average precision
+        report.rocAuc += (point.falsePositiveRate - previous.falsePositiveRate) * (point.recall + previous.recall) / 2;
+        report.averagePrecision += (point.recall - previous.recall) * point.precision;
+        report.curve.push_back(point);
+    }
+
+    report.best = report.curve.front();
+    for (const ThresholdMetrics& point : report.curve) {
+        if (point.accuracy > report.best.accuracy) {
+            report.best = point;
+        }
+    }
+    return report;
+}
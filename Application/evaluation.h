@@ -0,0 +1,29 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <Eigen/Dense>
+#include <vector>
+
+// Classification metrics when every probability > threshold is predicted positive
+struct ThresholdMetrics {
+    double threshold;
+    double accuracy;
+    double precision; // 1 when nothing is predicted positive
+    double recall;
+    double f1;
+    double falsePositiveRate;
+};
+
+struct EvaluationReport {
+    std::vector<ThresholdMetrics> curve; // one point per distinct cutoff, strictest (predict nothing) first
+    ThresholdMetrics best;                // highest accuracy; the strictest such cutoff on ties
+    double rocAuc = 0.0;                  // 0 when the labels hold a single class
+    double averagePrecision = 0.0;        // area under the precision-recall curve, step-wise; 0 without positives
+};
+
+// Scores are sorted once and every cutoff is swept in a single pass, so the whole curve costs
+// O(n log n) whatever the number of thresholds. Cutoffs lie halfway between neighbouring distinct
+// probabilities, so the chosen threshold does not sit on a training score.
+EvaluationReport evaluateProbabilities(const Eigen::VectorXd& probabilities, const Eigen::VectorXd& labels);
+
+#endif // EVALUATION_H
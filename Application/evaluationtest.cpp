@@ -0,0 +1,70 @@
+// Threshold sweep against a hand-computed example with tied scores, and the single-class and empty cases
+#include "evaluation.h"
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace {
+
+#define TOLERANCE 1e-12
+
+bool check(bool condition, const std::string& name) {
+    std::cout << (condition ? "ok   " : "FAIL ") << name << std::endl;
+    return condition;
+}
+
+bool near(double a, double b) {
+    return std::abs(a - b) <= TOLERANCE;
+}
+
+bool pointIs(const ThresholdMetrics& point, double threshold, double accuracy, double precision, double recall, double falsePositiveRate) {
+    return near(point.threshold, threshold) && near(point.accuracy, accuracy) && near(point.precision, precision)
+           && near(point.recall, recall) && near(point.falsePositiveRate, falsePositiveRate);
+}
+
+}
+
+int main() {
+    bool passed = true;
+
+    // Scores 0.9 0.8 0.8 0.3 0.1 with labels 1 1 0 0 1: three positives, two negatives, one tie across the classes.
+    // Lowering the cutoff past each distinct score gives (TP, FP) = (0,0) (1,0) (2,1) (2,2) (3,2).
+    Eigen::VectorXd probabilities(5), labels(5);
+    probabilities << 0.3, 0.8, 0.9, 0.1, 0.8;
+    labels << 0, 1, 1, 1, 0;
+    EvaluationReport report = evaluateProbabilities(probabilities, labels);
+
+    passed &= check(report.curve.size() == 5, "one point per distinct score plus predict-nothing");
+    if (report.curve.size() == 5) {
+        passed &= check(pointIs(report.curve[0], 1.0, 0.4, 1.0, 0.0, 0.0), "predict nothing");
+        passed &= check(pointIs(report.curve[1], 0.85, 0.6, 1.0, 1.0 / 3, 0.0), "cutoff 0.85");
+        passed &= check(pointIs(report.curve[2], 0.55, 0.6, 2.0 / 3, 2.0 / 3, 0.5), "tied scores cross the cutoff together");
+        passed &= check(pointIs(report.curve[3], 0.2, 0.4, 0.5, 2.0 / 3, 1.0), "cutoff 0.2");
+        passed &= check(pointIs(report.curve[4], -1.0, 0.6, 0.6, 1.0, 1.0), "predict everything");
+    }
+    // Of the cutoffs with accuracy 0.6, the strictest
+    passed &= check(near(report.best.threshold, 0.85) && near(report.best.accuracy, 0.6), "best cutoff");
+    // 3.5 of the 6 positive/negative pairs are ordered correctly, the tie counting half
+    passed &= check(near(report.rocAuc, 7.0 / 12), "ROC AUC");
+    // Recall steps of 1/3 at precisions 1, 2/3 and 0.6
+    passed &= check(near(report.averagePrecision, 1.0 / 3 + 2.0 / 9 + 0.2), "average precision");
+
+    // Only negatives: predicting nothing is perfect, and there is no ranking to score
+    Eigen::VectorXd negatives = Eigen::VectorXd::Zero(2);
+    Eigen::VectorXd scores(2);
+    scores << 0.2, 0.7;
+    report = evaluateProbabilities(scores, negatives);
+    passed &= check(near(report.best.threshold, 1.0) && near(report.best.accuracy, 1.0), "only negatives: best predicts nothing");
+    passed &= check(report.rocAuc == 0.0 && report.averagePrecision == 0.0, "only negatives: areas are 0");
+
+    // Only positives: predicting everything is perfect
+    Eigen::VectorXd positives = Eigen::VectorXd::Ones(2);
+    report = evaluateProbabilities(scores, positives);
+    passed &= check(report.best.threshold < 0.2 && near(report.best.accuracy, 1.0), "only positives: best predicts everything");
+    passed &= check(report.rocAuc == 0.0 && near(report.averagePrecision, 1.0), "only positives: ROC AUC 0, average precision 1");
+
+    report = evaluateProbabilities(Eigen::VectorXd(), Eigen::VectorXd());
+    passed &= check(report.curve.size() == 1 && report.best.accuracy == 0.0 && report.rocAuc == 0.0, "no samples");
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,217 @@
+#include "featureencoder.h"
+#include <algorithm>
+#include <array>
+
+#define SEQUENCE_BLOCK (COLOR_COUNT * 2 * GRID_SIZE) // features per placement slot: color x orientation x position
+#define SEQUENCE_FEATURES (WIRE_COUNT * SEQUENCE_BLOCK)
+#define COLOR_ORDER_FEATURES (COLOR_COUNT * (COLOR_COUNT - 1))
+
+namespace {
+
+using Entries = std::array<int, MAX_ENCODED_ENTRIES>;
+using Values = std::array<double, MAX_ENCODED_ENTRIES>;
+
+inline double sparseDot(const int* index, const double* value, int count, const Eigen::VectorXd& w) {
+    double sum = 0.0;
+    for (int a = 0; a < count; ++a) {
+        sum += value[a] * w(index[a]);
+    }
+    return sum;
+}
+
+// Adds weight * x x^T of one sparse row to the lower triangle of H
+inline void accumulateGram(const int* index, const double* value, int count, double weight, Eigen::MatrixXd& H) {
+    for (int a = 0; a < count; ++a) {
+        double scaled = weight * value[a];
+        for (int b = 0; b <= a; ++b) {
+            H(std::max(index[a], index[b]), std::min(index[a], index[b])) += scaled * value[b];
+        }
+    }
+}
+
+class GridEncoder : public FeatureEncoder {
+public:
+    FeatureEncoding encoding() const override { return FeatureEncoding::Grid; }
+    const char* name() const override { return "grid"; }
+    Eigen::Index featureCount() const override { return DENSE_FEATURES; }
+    int encodeSparse(const Diagram& diagram, int* index, double* value) const override {
+        return diagramCells(diagram, index, value);
+    }
+
+    // Line sums beat walking the up to 80 cells of every row
+    void multiply(const Diagram* diagrams, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override {
+        diagramMultiply(diagrams, count, w, z);
+    }
+    std::unique_ptr<DesignMatrix> design(const std::vector<Diagram>& diagrams) const override {
+        return std::make_unique<DiagramDesign>(diagrams);
+    }
+};
+
+class WireSequenceEncoder : public FeatureEncoder {
+public:
+    FeatureEncoding encoding() const override { return FeatureEncoding::WireSequence; }
+    const char* name() const override { return "sequence"; }
+    Eigen::Index featureCount() const override { return SEQUENCE_FEATURES; }
+    int encodeSparse(const Diagram& diagram, int* index, double* value) const override {
+        // One entry per laid wire, at (slot, color, orientation, position); slots ascend, so the indices do too.
+        // A wire of an unknown color is written and dropped by not advancing entries.
+        int entries = 0;
+        for (int k = 0; k < diagram.wireCount; ++k) {
+            const Wire& wire = diagram.wires[k];
+            index[entries] = ((k * COLOR_COUNT + wire.color - 1) * 2 + (wire.isRow ? 1 : 0)) * GRID_SIZE + wire.position;
+            value[entries] = 1.0;
+            entries += wire.color >= 1 && wire.color <= COLOR_COUNT;
+        }
+        return entries;
+    }
+};
+
+class ColorOrderEncoder : public FeatureEncoder {
+public:
+    FeatureEncoding encoding() const override { return FeatureEncoding::ColorOrder; }
+    const char* name() const override { return "order"; }
+    Eigen::Index featureCount() const override { return COLOR_ORDER_FEATURES; }
+    int encodeSparse(const Diagram& diagram, int* index, double* value) const override {
+        // Some wire of color a precedes some wire of color b exactly when a first appears before b last does
+        std::array<int, COLOR_COUNT + 1> first, last;
+        first.fill(WIRE_COUNT);
+        last.fill(-1);
+        for (int k = 0; k < diagram.wireCount; ++k) {
+            const int color = std::min<int>(diagram.wires[k].color, COLOR_COUNT + 1) % (COLOR_COUNT + 1); // unknown colors to 0
+            first[color] = std::min(first[color], k);
+            last[color] = k;
+        }
+
+        // Pair (a, b) of distinct colors sits at (a - 1) * (COLOR_COUNT - 1) + the rank of b among the other colors.
+        // Every candidate is written and only kept by advancing entries, since the outcome is a coin flip per pair.
+        int entries = 0;
+        int feature = 0;
+        for (int a = 1; a <= COLOR_COUNT; ++a) {
+            for (int b = 1; b <= COLOR_COUNT; ++b) {
+                if (a != b) {
+                    index[entries] = feature++;
+                    value[entries] = 1.0;
+                    entries += first[a] < last[b];
+                }
+            }
+        }
+        return entries;
+    }
+};
+
+}
+
+void FeatureEncoder::multiply(const Diagram* diagrams, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    Entries index;
+    Values value;
+    for (Eigen::Index i = 0; i < count; ++i) {
+        int entries = encodeSparse(diagrams[i], index.data(), value.data());
+        z(i) = sparseDot(index.data(), value.data(), entries, w);
+    }
+}
+
+std::unique_ptr<DesignMatrix> FeatureEncoder::design(const std::vector<Diagram>& diagrams) const {
+    return std::make_unique<EncodedDesign>(diagrams, *this);
+}
+
+Eigen::VectorXd FeatureEncoder::encode(const Diagram& diagram) const {
+    Entries index;
+    Values value;
+    Eigen::VectorXd features = Eigen::VectorXd::Zero(featureCount());
+    int entries = encodeSparse(diagram, index.data(), value.data());
+    for (int a = 0; a < entries; ++a) {
+        features(index[a]) = value[a];
+    }
+    return features;
+}
+
+const FeatureEncoder& featureEncoder(FeatureEncoding encoding) {
+    static const GridEncoder grid;
+    static const WireSequenceEncoder sequence;
+    static const ColorOrderEncoder order;
+    switch (encoding) {
+    case FeatureEncoding::WireSequence: return sequence;
+    case FeatureEncoding::ColorOrder: return order;
+    default: return grid;
+    }
+}
+
+bool parseFeatureEncoding(std::string_view name, FeatureEncoding& encoding) {
+    for (FeatureEncoding candidate : {FeatureEncoding::Grid, FeatureEncoding::WireSequence, FeatureEncoding::ColorOrder}) {
+        if (name == featureEncoder(candidate).name()) {
+            encoding = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+void EncodedDesign::multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const {
+    z.resize(rows());
+    encoder.multiply(diagrams.data(), rows(), w, z);
+}
+
+void EncodedDesign::transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const {
+    transposeMultiplyRange(0, rows(), r, g);
+}
+
+void EncodedDesign::multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    encoder.multiply(diagrams.data() + begin, count, w, z);
+}
+
+void EncodedDesign::transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    Entries index;
+    Values value;
+    g.setZero(cols());
+    for (Eigen::Index i = 0; i < count; ++i) {
+        int entries = encoder.encodeSparse(diagrams[begin + i], index.data(), value.data());
+        for (int a = 0; a < entries; ++a) {
+            g(index[a]) += r(i) * value[a];
+        }
+    }
+}
+
+void EncodedDesign::multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    Entries index;
+    Values value;
+    for (Eigen::Index i = 0; i < count; ++i) {
+        int entries = encoder.encodeSparse(diagrams[rows[i]], index.data(), value.data());
+        z(i) = sparseDot(index.data(), value.data(), entries, w);
+    }
+}
+
+void EncodedDesign::transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    Entries index;
+    Values value;
+    g.setZero(cols());
+    for (Eigen::Index i = 0; i < count; ++i) {
+        int entries = encoder.encodeSparse(diagrams[rows[i]], index.data(), value.data());
+        for (int a = 0; a < entries; ++a) {
+            g(index[a]) += r(i) * value[a];
+        }
+    }
+}
+
+void EncodedDesign::weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const {
+    Entries index;
+    Values value;
+    H.setZero(cols(), cols());
+    for (Eigen::Index i = 0; i < rows(); ++i) {
+        int entries = encoder.encodeSparse(diagrams[i], index.data(), value.data());
+        accumulateGram(index.data(), value.data(), entries, s(i), H);
+    }
+
+    H.triangularView<Eigen::StrictlyUpper>() = H.transpose();
+}
+
+void EncodedDesign::weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const {
+    Entries index;
+    Values value;
+    H.setZero(cols(), cols());
+    for (Eigen::Index i = 0; i < count; ++i) {
+        int entries = encoder.encodeSparse(diagrams[rows[i]], index.data(), value.data());
+        accumulateGram(index.data(), value.data(), entries, s(i), H);
+    }
+
+    H.triangularView<Eigen::StrictlyUpper>() = H.transpose();
+}
@@ -0,0 +1,68 @@
+#ifndef FEATUREENCODER_H
+#define FEATUREENCODER_H
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "diagram.h"
+#include "designmatrix.h"
+
+#define COLOR_COUNT 4 // encodeColor values 1..COLOR_COUNT
+#define MAX_ENCODED_ENTRIES MAX_DIAGRAM_CELLS // nonzero entries of one row under any encoder, at most
+
+// Which features a model is trained on; the value is saved in model files, so never renumber
+enum class FeatureEncoding : uint32_t {
+    Grid = 0,         // 400 painted-cell colors (DENSE_FEATURES)
+    WireSequence = 1, // one-hot placement order x color x orientation x position of each laid wire (640)
+    ColorOrder = 2    // one indicator per ordered color pair: a wire of the first color was laid before one of the second
+};
+
+// Turns a compact diagram into a feature row. Every encoder describes a row by its nonzero entries, which
+// is all the products need, so a design over diagrams never materializes the rows.
+class FeatureEncoder {
+public:
+    virtual ~FeatureEncoder() = default;
+
+    virtual FeatureEncoding encoding() const = 0;
+    virtual const char* name() const = 0;
+    virtual Eigen::Index featureCount() const = 0;
+    // Writes the nonzero entries of the row to index/value, which hold MAX_ENCODED_ENTRIES slots; returns how many
+    virtual int encodeSparse(const Diagram& diagram, int* index, double* value) const = 0;
+
+    // z = X * w over a contiguous block of diagrams
+    virtual void multiply(const Diagram* diagrams, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const;
+    // The design used for FeatureStorage::Diagram; diagrams must outlive it
+    virtual std::unique_ptr<DesignMatrix> design(const std::vector<Diagram>& diagrams) const;
+
+    // The full featureCount() row, for storages that keep materialized rows
+    Eigen::VectorXd encode(const Diagram& diagram) const;
+};
+
+const FeatureEncoder& featureEncoder(FeatureEncoding encoding);
+// "grid", "sequence" or "order"; false for anything else
+bool parseFeatureEncoding(std::string_view name, FeatureEncoding& encoding);
+
+// Design matrix whose rows are encoded from the diagrams inside every product
+class EncodedDesign : public DesignMatrix {
+public:
+    EncodedDesign(const std::vector<Diagram>& diagrams, const FeatureEncoder& encoder) : diagrams(diagrams), encoder(encoder) {}
+
+    Eigen::Index rows() const override { return static_cast<Eigen::Index>(diagrams.size()); }
+    Eigen::Index cols() const override { return encoder.featureCount(); }
+    void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const override;
+    void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const override;
+    void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const override;
+    void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const override;
+
+private:
+    const std::vector<Diagram>& diagrams;
+    const FeatureEncoder& encoder;
+};
+
+#endif // FEATUREENCODER_H
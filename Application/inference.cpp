@@ -0,0 +1,229 @@
+#include "inference.h"
+#include "mappedfile.h"
+#include "activation.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+
+#define SCORE_BLOCK_ROWS 65536
+#define SCORE_BLOCK_BYTES (1 << 22)
+
+namespace {
+
+struct ScoredBlock {
+    Eigen::VectorXd probabilities;
+    std::vector<uint8_t> labels;
+    size_t scored = 0;
+    size_t lineCount = 0;
+    std::vector<CsvParseError> errors; // line numbers relative to the block
+};
+
+void scoreBlock(const FeatureEncoder& encoder, const Diagram* diagrams, size_t count, const Eigen::VectorXd& weights, double bias,
+                double threshold, ScoredBlock& block) {
+    block.probabilities.resize(count);
+    encoder.multiply(diagrams, count, weights, block.probabilities);
+    sigmoid(block.probabilities.data(), bias, block.probabilities.data(), count);
+    block.labels.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        block.labels[i] = block.probabilities(i) > threshold;
+    }
+    block.scored = count;
+}
+
+ScoredBlock parseAndScore(const FeatureEncoder& encoder, const char* begin, const char* end, const Eigen::VectorXd& weights,
+                          double bias, double threshold) {
+    // Each pool thread reuses its parse buffer for every block it scores
+    thread_local std::vector<Diagram> diagrams;
+    thread_local std::vector<size_t> unscored; // block-relative 0-based lines, ascending
+    diagrams.clear();
+    unscored.clear();
+
+    ScoredBlock block;
+    std::string error;
+    const char* cursor = begin;
+    while (cursor < end) {
+        const char* newline = static_cast<const char*>(std::memchr(cursor, '\n', end - cursor));
+        const char* lineEnd = newline ? newline : end;
+        std::string_view line = trimCell(std::string_view(cursor, lineEnd - cursor));
+        cursor = lineEnd + 1;
+        ++block.lineCount;
+
+        Diagram diagram;
+        if (!line.empty() && parseDiagramWires(line, diagram, error)) {
+            diagrams.push_back(diagram);
+            continue;
+        }
+        if (!line.empty()) {
+            block.errors.push_back({block.lineCount, error});
+        }
+        unscored.push_back(block.lineCount - 1);
+    }
+
+    scoreBlock(encoder, diagrams.data(), diagrams.size(), weights, bias, threshold, block);
+    if (unscored.empty()) {
+        return block;
+    }
+
+    // Blank and malformed lines keep their place in the output as NaN probabilities. Spread the scored rows out
+    // from the back, so each moves to its line before anything overwrites it.
+    block.probabilities.conservativeResize(block.lineCount);
+    block.labels.resize(block.lineCount);
+    size_t scoredRow = block.scored;
+    size_t gap = unscored.size();
+    for (size_t line = block.lineCount; line-- > 0;) {
+        if (gap > 0 && unscored[gap - 1] == line) {
+            block.probabilities(line) = std::numeric_limits<double>::quiet_NaN();
+            block.labels[line] = 0;
+            --gap;
+        } else {
+            --scoredRow;
+            block.probabilities(line) = block.probabilities(scoredRow);
+            block.labels[line] = block.labels[scoredRow];
+        }
+    }
+    return block;
+}
+
+bool scoresWith(const LogisticRegression& model, const FeatureEncoder& encoder) {
+    // Also catches an unfitted model, whose weights are empty
+    return model.getWeights().size() == encoder.featureCount();
+}
+
+// Runs produce(0..blockCount) on the pool with a bounded window in flight and consumes the results in order
+template <typename Produce, typename Consume>
+void inOrder(size_t blockCount, ThreadPool& pool, Produce produce, Consume consume) {
+    const size_t window = pool.size() * 2;
+    std::deque<std::future<ScoredBlock>> pending;
+    size_t submitted = 0;
+
+    while (submitted < blockCount && pending.size() < window) {
+        pending.push_back(pool.submit([produce, submitted]() { return produce(submitted); }));
+        ++submitted;
+    }
+    while (!pending.empty()) {
+        ScoredBlock block = pending.front().get();
+        pending.pop_front();
+        if (submitted < blockCount) {
+            pending.push_back(pool.submit([produce, submitted]() { return produce(submitted); }));
+            ++submitted;
+        }
+        consume(block);
+    }
+}
+
+}
+
+CsvScoreSink::CsvScoreSink(const std::string& path, size_t bufferBytes)
+    : file(path, std::ios::binary | std::ios::trunc), bufferLimit(bufferBytes) {
+    buffer.reserve(bufferBytes + 64);
+}
+
+CsvScoreSink::~CsvScoreSink() {
+    flush();
+}
+
+void CsvScoreSink::write(const double* probabilities, const uint8_t* labels, size_t count) {
+    char number[32];
+    for (size_t i = 0; i < count; ++i) {
+        if (std::isnan(probabilities[i])) {
+            buffer += "Unscored,\n";
+        } else {
+            buffer += labels[i] ? "Dangerous," : "Safe,";
+            char* end = std::to_chars(number, number + sizeof(number), probabilities[i], std::chars_format::fixed, 6).ptr;
+            buffer.append(number, end);
+            buffer += '\n';
+        }
+
+        if (buffer.size() >= bufferLimit) {
+            flush();
+        }
+    }
+}
+
+void CsvScoreSink::flush() {
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    buffer.clear();
+}
+
+void MemoryScoreSink::write(const double* probabilities, const uint8_t* labels, size_t count) {
+    scores.insert(scores.end(), probabilities, probabilities + count);
+    predicted.insert(predicted.end(), labels, labels + count);
+}
+
+bool scoreDiagrams(const LogisticRegression& model, const FeatureEncoder& encoder, const Diagram* diagrams, size_t count,
+                   ThreadPool& pool, ScoreSink& sink) {
+    if (!scoresWith(model, encoder)) {
+        return false;
+    }
+    const Eigen::VectorXd weights = model.getWeights();
+    const double bias = model.getBias();
+    const double threshold = model.getThreshold();
+    const size_t blockCount = (count + SCORE_BLOCK_ROWS - 1) / SCORE_BLOCK_ROWS;
+
+    auto produce = [&encoder, &weights, bias, threshold, diagrams, count](size_t index) {
+        size_t first = index * SCORE_BLOCK_ROWS;
+        ScoredBlock block;
+        scoreBlock(encoder, diagrams + first, std::min<size_t>(SCORE_BLOCK_ROWS, count - first), weights, bias, threshold, block);
+        return block;
+    };
+    inOrder(blockCount, pool, produce, [&sink](const ScoredBlock& block) {
+        sink.write(block.probabilities.data(), block.labels.data(), block.labels.size());
+    });
+    sink.flush();
+    return true;
+}
+
+bool scoreDiagramCsv(const LogisticRegression& model, const FeatureEncoder& encoder, const std::string& path, ThreadPool& pool, ScoreSink& sink,
+                     std::vector<CsvParseError>& errors, CsvParseStats& stats) {
+    auto start = std::chrono::steady_clock::now();
+    if (!scoresWith(model, encoder)) {
+        return false;
+    }
+    MappedFile file(path);
+    if (!file.isOpen()) {
+        return false;
+    }
+
+    // Block boundaries sit just after a newline, so every block holds whole lines
+    const char* data = file.data();
+    const char* fileEnd = data + file.size();
+    std::vector<const char*> bounds = {data};
+    while (bounds.back() < fileEnd) {
+        const char* end = bounds.back() + std::min<size_t>(SCORE_BLOCK_BYTES, fileEnd - bounds.back());
+        if (end < fileEnd) {
+            const char* newline = static_cast<const char*>(std::memchr(end, '\n', fileEnd - end));
+            end = newline ? newline + 1 : fileEnd;
+        }
+        bounds.push_back(end);
+    }
+
+    const Eigen::VectorXd weights = model.getWeights();
+    const double bias = model.getBias();
+    const double threshold = model.getThreshold();
+    auto produce = [&encoder, &weights, bias, threshold, &bounds](size_t index) {
+        return parseAndScore(encoder, bounds[index], bounds[index + 1], weights, bias, threshold);
+    };
+
+    size_t linesBefore = 0;
+    errors.clear();
+    stats.rows = 0;
+    inOrder(bounds.size() - 1, pool, produce, [&](const ScoredBlock& block) {
+        sink.write(block.probabilities.data(), block.labels.data(), block.labels.size());
+        for (const CsvParseError& error : block.errors) {
+            errors.push_back({linesBefore + error.line, error.message});
+        }
+        linesBefore += block.lineCount;
+        stats.rows += block.scored;
+    });
+    sink.flush();
+
+    stats.bytes = file.size();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
@@ -0,0 +1,67 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "diagram.h"
+#include "csvparser.h"
+#include "logisticregression.h"
+#include "featureencoder.h"
+#include "threadpool.h"
+
+// Destination for scored diagrams. Blocks arrive in input order. When scoring a CSV, a blank or malformed line
+// arrives as a NaN probability with label 0, so output k still belongs to input line k.
+class ScoreSink {
+public:
+    virtual ~ScoreSink() = default;
+
+    virtual void write(const double* probabilities, const uint8_t* labels, size_t count) = 0;
+    virtual void flush() {}
+};
+
+// One "Dangerous,0.912345" line per diagram ("Unscored," for a NaN probability), formatted into a large buffer
+// and written in big blocks
+class CsvScoreSink : public ScoreSink {
+public:
+    explicit CsvScoreSink(const std::string& path, size_t bufferBytes = 1 << 22);
+    ~CsvScoreSink() override;
+
+    bool isOpen() const { return file.is_open(); }
+    void write(const double* probabilities, const uint8_t* labels, size_t count) override;
+    void flush() override;
+
+private:
+    std::ofstream file;
+    std::string buffer;
+    size_t bufferLimit;
+};
+
+class MemoryScoreSink : public ScoreSink {
+public:
+    void write(const double* probabilities, const uint8_t* labels, size_t count) override;
+
+    const std::vector<double>& probabilities() const { return scores; }
+    const std::vector<uint8_t>& labels() const { return predicted; }
+
+private:
+    std::vector<double> scores;
+    std::vector<uint8_t> predicted;
+};
+
+// Scores count diagrams on the pool in fixed-size blocks, one compact matrix-vector product per block,
+// and hands the probabilities and thresholded labels to sink in input order. encoder must be the one the
+// model was trained with; returns false and writes nothing if the model is unfitted or has another feature count.
+bool scoreDiagrams(const LogisticRegression& model, const FeatureEncoder& encoder, const Diagram* diagrams, size_t count,
+                   ThreadPool& pool, ScoreSink& sink);
+
+// Streams a diagram CSV (labelled or not) through the model: the mapped file is cut into newline-aligned
+// blocks that are parsed and scored on the pool, with only a bounded window of blocks in flight.
+// Every input line gets one output in order; blank and malformed lines get a NaN placeholder, and malformed ones
+// are also listed in errors. stats.rows counts the scored lines. Returns false if the file cannot be opened or,
+// as for scoreDiagrams, the model cannot score this encoder's rows.
+bool scoreDiagramCsv(const LogisticRegression& model, const FeatureEncoder& encoder, const std::string& path, ThreadPool& pool,
+                     ScoreSink& sink, std::vector<CsvParseError>& errors, CsvParseStats& stats);
+
+#endif // INFERENCE_H
@@ -0,0 +1,89 @@
+// Scoring: an unfitted model or one of another width is refused, and a CSV with blank and malformed lines,
+// long enough for several scoring blocks, gets exactly one output per input line, in order.
+#include "inference.h"
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace {
+
+#define LINES 600000 // about 10 MB, more than two 4 MB scoring blocks
+#define MALFORMED_EVERY 9973
+#define BLANK_EVERY 7919
+
+bool check(bool condition, const std::string& name) {
+    std::cout << (condition ? "ok   " : "FAIL ") << name << std::endl;
+    return condition;
+}
+
+}
+
+int main() {
+    const FeatureEncoder& encoder = featureEncoder(FeatureEncoding::Grid);
+    ThreadPool pool(3);
+    bool passed = true;
+
+    std::vector<Diagram> diagrams(2);
+    diagrams[0].addWire(true, 3, 2);
+    MemoryScoreSink refused;
+    LogisticRegression unfitted(0.1, 10, 0.0);
+    passed &= check(!scoreDiagrams(unfitted, encoder, diagrams.data(), diagrams.size(), pool, refused) && refused.probabilities().empty(),
+                    "unfitted model refused");
+    LogisticRegression narrow(0.1, 10, 0.0);
+    narrow.setWeights(Eigen::VectorXd::Ones(12));
+    passed &= check(!scoreDiagrams(narrow, encoder, diagrams.data(), diagrams.size(), pool, refused), "model of another width refused");
+
+    // Weight 1 on the cells of row 0 only: a row wire there of color c scores sigmoid(20 c - 30)
+    LogisticRegression model(0.1, 10, 0.0);
+    Eigen::VectorXd weights = Eigen::VectorXd::Zero(encoder.featureCount());
+    weights.head(GRID_SIZE).setOnes();
+    model.setWeights(weights, -30.0);
+
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "diagram-inferencetest";
+    std::filesystem::create_directories(directory);
+    const std::string csvPath = (directory / "input.csv").string();
+    {
+        std::ofstream out(csvPath, std::ios::binary | std::ios::trunc);
+        for (int i = 1; i <= LINES; ++i) {
+            if (i % MALFORMED_EVERY == 0) {
+                out << "Row 1 Purple\n";
+            } else if (i % BLANK_EVERY == 0) {
+                out << "\n";
+            } else {
+                out << (i % 2 ? "Row 1 " : "Column 1 ") << colorName(i % 4 + 1) << ",Safe\n";
+            }
+        }
+    }
+
+    MemoryScoreSink scores;
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    passed &= check(!scoreDiagramCsv(unfitted, encoder, csvPath, pool, scores, errors, stats) && scores.probabilities().empty(),
+                    "unfitted model refused for a file");
+    passed &= check(scoreDiagramCsv(model, encoder, csvPath, pool, scores, errors, stats), "file scored");
+
+    bool aligned = scores.probabilities().size() == LINES;
+    size_t malformed = 0, scored = 0;
+    for (int i = 1; aligned && i <= LINES; ++i) {
+        const double probability = scores.probabilities()[i - 1];
+        if (i % MALFORMED_EVERY == 0 || i % BLANK_EVERY == 0) {
+            aligned &= std::isnan(probability) && scores.labels()[i - 1] == 0;
+            if (i % MALFORMED_EVERY == 0) {
+                aligned &= malformed < errors.size() && errors[malformed].line == static_cast<size_t>(i);
+                ++malformed;
+            }
+            continue;
+        }
+        // A column wire crosses row 0 in one cell only
+        const double color = i % 4 + 1;
+        const double expected = 1.0 / (1.0 + std::exp(-((i % 2 ? GRID_SIZE : 1) * color - 30.0)));
+        aligned &= std::abs(probability - expected) <= 1e-12 && scores.labels()[i - 1] == (expected > 0.5);
+        ++scored;
+    }
+    passed &= check(aligned, "one output per input line, placeholders at blank and malformed lines");
+    passed &= check(malformed == errors.size() && stats.rows == scored, "errors and scored row count");
+
+    std::filesystem::remove_all(directory);
+    return passed ? 0 : 1;
+}
@@ -1,85 +1,449 @@
 #include "logisticregression.h"
+#include "activation.h"
 #include <cmath>
-#include <QProgressDialog>
-#include <QApplication>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <limits>
 
+namespace {
+
+// Largest loss change still counted as no change: tolerance itself below a loss of 1, tolerance times the loss
+// above, so the test stays meaningful both near a perfect fit and for large losses
+inline double lossTolerance(double tolerance, double loss) {
+    return tolerance * std::max(1.0, std::abs(loss));
+}
+
+}
+
+void TrainingWorkspace::reserve(Eigen::Index samples, Eigen::Index features) {
+    // resize() keeps the existing storage when the size is unchanged
+    linear.resize(samples);
+    gradients.resize(features);
+}
 
 LogisticRegression::LogisticRegression(double lr, int iter, double regStrength, RegularizationType regType)
-    : learningRate(lr), iterations(iter), regularizationStrength(regStrength), regType(regType) {
+    : learningRate(lr), iterations(iter), regularizationStrength(regStrength), regType(regType), seed(0),
+      solver(SolverType::GradientDescent), batchSize(256), tolerance(1e-4), warmStart(false), bias(0.0), samplesSeen(0) {
     threshold = 0.5;
 }
 
-void LogisticRegression::fit(const Eigen::MatrixXd& X, const Eigen::VectorXd& y, QProgressDialog& progressDialog) {
-    size_t n_features = X.cols();
-    weights = Eigen::VectorXd::Random(n_features); // Small random initialization
+void LogisticRegression::fit(const Eigen::MatrixXd& X, const Eigen::VectorXd& y, const IterationCallback& onIteration) {
+    fit(DenseDesign(X), y, onIteration);
+}
 
-    progressDialog.setRange(0, iterations);
-    progressDialog.setValue(0);
+void LogisticRegression::fit(const DesignMatrix& X, const Eigen::VectorXd& y, const IterationCallback& onIteration) {
+    TrainingWorkspace workspace;
+    fit(X, y, workspace, onIteration);
+}
 
-    for (int i = 0; i < iterations; ++i) {
-        Eigen::VectorXd gradients = computeGradient(X, y);
-        weights -= learningRate * gradients;
+void LogisticRegression::initializeWeights(Eigen::Index n_features) {
+    // Small random initialization in [-1, 1], drawn from a per-model generator so that
+    // concurrent fits neither share state nor depend on scheduling order
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<double> dis(-1.0, 1.0);
+    weights = Eigen::VectorXd::NullaryExpr(n_features, [&]() { return dis(gen); });
+    bias = 0.0;
 
-        // Update the progress dialog
-        progressDialog.setValue(i);
-        QApplication::processEvents();
+    shuffleGen.seed(seed + 1);
+    samplesSeen = 0;
+}
 
-        // Check if the operation was canceled
-        if (progressDialog.wasCanceled()) {
-            break;
-        }
+void LogisticRegression::fit(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, const IterationCallback& onIteration) {
+    size_t n_features = X.cols();
+    if (!warmStart || weights.size() != X.cols()) {
+        initializeWeights(n_features);
     }
+    samplesSeen = X.rows();
+    lossHistory = LossHistory();
+    Monitor monitor;
 
-    progressDialog.setValue(iterations); // Indicate completion
+    if (solver == SolverType::MiniBatchSGD) {
+        workspace.reserve(std::min<Eigen::Index>(std::max(batchSize, 1), X.rows()), n_features);
+        lossHistory.iterationsRun = fitMiniBatch(X, y, workspace, monitor, onIteration);
+    } else {
+        workspace.reserve(X.rows(), n_features);
+        lossHistory.iterationsRun = (solver == SolverType::LBFGS || solver == SolverType::Newton)
+                                        ? fitSecondOrder(X, y, workspace, monitor, onIteration)
+                                        : fitGradientDescent(X, y, workspace, monitor, onIteration);
+    }
+    finishMonitoring(X, y, workspace, monitor);
 }
 
+int LogisticRegression::fitGradientDescent(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace,
+                                           Monitor& monitor, const IterationCallback& onIteration) {
+    for (int i = 0; i < iterations; ++i) {
+        // A check reads the loss off the product the gradient needs anyway, before stepping away from it
+        double loss = 0.0;
+        computeGradient(X, y, workspace, isCheck(i) ? &loss : nullptr);
+        if (isCheck(i) && !checkLoss(i, loss, workspace, monitor)) {
+            return i;
+        }
+        weights -= learningRate * workspace.gradients;
+        bias -= learningRate * workspace.biasGradient;
+
+        if (onIteration && !onIteration(i)) {
+            return i + 1;
+        }
+    }
+    return iterations;
+}
 
 Eigen::VectorXd LogisticRegression::predict(const Eigen::MatrixXd& X) const {
-    Eigen::VectorXd predictions = (X * weights).unaryExpr(&LogisticRegression::sigmoid);
-    return (predictions.array() > threshold).cast<double>();
+    return predict(DenseDesign(X));
 }
 
-double LogisticRegression::sigmoid(double z) {
-    return 1.0 / (1.0 + exp(-z));
+Eigen::VectorXd LogisticRegression::predict(const DesignMatrix& X) const {
+    Eigen::VectorXd predictions;
+    X.multiply(weights, predictions);
+    sigmoid(predictions.data(), bias, predictions.data(), predictions.size());
+    for (Eigen::Index i = 0; i < predictions.size(); ++i) {
+        predictions(i) = predictions(i) > threshold ? 1.0 : 0.0;
+    }
+    return predictions;
+}
+
+Eigen::VectorXd LogisticRegression::predictProbabilities(const DesignMatrix& X) const {
+    Eigen::VectorXd probabilities;
+    X.multiply(weights, probabilities);
+    sigmoid(probabilities.data(), bias, probabilities.data(), probabilities.size());
+    return probabilities;
 }
 
-int LogisticRegression::singlePrediction(const Eigen::VectorXd& extendedFeatures) {
-    // Assuming that 'weights' is the trained model parameters
-    double linearCombination = extendedFeatures.dot(weights);
-    double probability = 1.0 / (1.0 + exp(-linearCombination));
+int LogisticRegression::singlePrediction(const Eigen::VectorXd& features) {
+    // Assuming that 'weights' and 'bias' are the trained model parameters
+    double linearCombination = features.dot(weights);
+    double probability;
+    sigmoid(&linearCombination, bias, &probability, 1);
 
     return (probability > threshold) ? 1 : 0;  // Return 1 for 'Dangerous', 0 for 'Safe'
 }
 
-double LogisticRegression::computeCost(const Eigen::MatrixXd& X, const Eigen::VectorXd& y) const {
-    Eigen::VectorXd predictions = (X * weights).unaryExpr(&LogisticRegression::sigmoid);
-    double cost = -(y.array() * predictions.array().log() + (1 - y.array()) * (1 - predictions.array()).log()).mean();
+double LogisticRegression::computeCost(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace) const {
+    Eigen::VectorXd& linear = workspace.linear;
+    X.multiply(weights, linear);
+    double cost = logisticLoss(linear.data(), bias, y.data(), linear.size()) / X.rows();
+    return cost + regularizationCost(X.rows());
+}
 
-    // Add regularization term
+double LogisticRegression::regularizationCost(Eigen::Index samples) const {
+    // Matches what computeGradient differentiates; the bias is not penalized
     double regTerm = 0.0;
     if (regType == RegularizationType::L1) {
-        regTerm = weights.array().abs().sum();
+        regTerm = 2 * weights.array().abs().sum();
     } else if (regType == RegularizationType::L2) {
         regTerm = weights.squaredNorm();
     }
-    cost += (regularizationStrength / (2 * X.rows())) * regTerm;
-
-    return cost;
+    return (regularizationStrength / (2 * samples)) * regTerm;
 }
 
-Eigen::VectorXd LogisticRegression::computeGradient(const Eigen::MatrixXd& X, const Eigen::VectorXd& y) const {
-    Eigen::VectorXd predictions = (X * weights).unaryExpr(&LogisticRegression::sigmoid);
-    Eigen::VectorXd gradients = X.transpose() * (predictions - y) / X.rows();
+void LogisticRegression::computeGradient(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, double* loss) const {
+    // Sigmoid and residual in one in-place pass over X * w, so no temporaries are created
+    Eigen::VectorXd& residuals = workspace.linear;
+    X.multiply(weights, residuals);
+    if (loss) {
+        *loss = logisticLoss(residuals.data(), bias, y.data(), residuals.size()) / X.rows();
+    }
+    sigmoid(residuals.data(), bias, residuals.data(), residuals.size());
+    residuals -= y;
+
+    X.transposeMultiply(residuals, workspace.gradients);
+    workspace.gradients /= X.rows();
+    workspace.biasGradient = residuals.sum() / X.rows();
+    addRegularizationGradient(workspace.gradients, X.rows());
+}
 
-    // Regularization gradients
+void LogisticRegression::addRegularizationGradient(Eigen::VectorXd& gradients, Eigen::Index samples) const {
+    // Scaled by the full sample count, so a mini-batch step estimates the same objective as a full step
     if (regType == RegularizationType::L1) {
         for (int i = 0; i < weights.size(); ++i) {
-            gradients[i] += regularizationStrength * (weights[i] > 0 ? 1 : -1) / X.rows();
+            gradients[i] += regularizationStrength * (weights[i] > 0 ? 1 : -1) / samples;
         }
     } else if (regType == RegularizationType::L2) {
-        gradients += regularizationStrength * weights / X.rows();
+        gradients += regularizationStrength * weights / samples;
+    }
+}
+
+int LogisticRegression::fitMiniBatch(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor,
+                                     const IterationCallback& onIteration) {
+    // Epochs visit the rows through a shuffled index list; the data itself is never reordered
+    std::vector<int>& order = workspace.order;
+    order.resize(X.rows());
+    std::iota(order.begin(), order.end(), 0);
+    double previousLoss = std::numeric_limits<double>::infinity();
+
+    if (isCheck(0) && !checkLoss(0, computeCost(X, y, workspace) - regularizationCost(X.rows()), workspace, monitor)) {
+        return 0;
+    }
+    for (int epoch = 0; epoch < iterations; ++epoch) {
+        double epochLoss = miniBatchEpoch(X, y, order, workspace);
+        if (isCheck(epoch + 1) && !checkLoss(epoch + 1, epochLoss, workspace, monitor)) {
+            return epoch + 1;
+        }
+
+        // Converged once the mean training loss of an epoch stops moving
+        bool converged = std::abs(previousLoss - epochLoss) <= lossTolerance(tolerance, epochLoss);
+        previousLoss = epochLoss;
+
+        if ((onIteration && !onIteration(epoch)) || converged) {
+            return epoch + 1;
+        }
+    }
+    return iterations;
+}
+
+double LogisticRegression::miniBatchEpoch(const DesignMatrix& X, const Eigen::VectorXd& y, std::vector<int>& order,
+                                          TrainingWorkspace& workspace) {
+    const Eigen::Index samples = X.rows();
+    const Eigen::Index batch = std::max<Eigen::Index>(1, std::min<Eigen::Index>(batchSize, samples));
+    Eigen::VectorXd& gradients = workspace.gradients;
+
+    // Only this path gathers labels, so full-batch fits never size the buffer
+    workspace.labels.resize(batch);
+    std::shuffle(order.begin(), order.end(), shuffleGen);
+    double epochLoss = 0.0;
+
+    for (Eigen::Index start = 0; start < samples; start += batch) {
+        const int* rows = order.data() + start;
+        const Eigen::Index count = std::min(batch, samples - start);
+
+        auto residuals = workspace.linear.head(count);
+        auto labels = workspace.labels.head(count);
+        X.multiplyRows(rows, count, weights, residuals);
+        for (Eigen::Index i = 0; i < count; ++i) {
+            labels(i) = y(rows[i]);
+        }
+        // The loss reads the scores before sigmoid overwrites them
+        epochLoss += logisticLoss(residuals.data(), bias, labels.data(), count);
+        sigmoid(residuals.data(), bias, residuals.data(), count);
+        residuals -= labels;
+
+        X.transposeMultiplyRows(rows, count, residuals, gradients);
+        gradients /= count;
+        addRegularizationGradient(gradients, samplesSeen);
+        weights -= learningRate * gradients;
+        bias -= learningRate * residuals.sum() / count;
+    }
+
+    return epochLoss / samples;
+}
+
+void LogisticRegression::partialFit(const DesignMatrix& X, const Eigen::VectorXd& y, int epochs) {
+    TrainingWorkspace workspace;
+    partialFit(X, y, workspace, epochs);
+}
+
+void LogisticRegression::partialFit(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, int epochs) {
+    if (weights.size() != X.cols()) {
+        initializeWeights(X.cols());
+    }
+
+    // The regularization term is weighted against everything seen so far, as a full fit on all of it would be
+    samplesSeen += X.rows();
+
+    workspace.reserve(std::min<Eigen::Index>(std::max(batchSize, 1), X.rows()), X.cols());
+    std::vector<int>& order = workspace.order;
+    order.resize(X.rows());
+    std::iota(order.begin(), order.end(), 0);
+
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        miniBatchEpoch(X, y, order, workspace);
+    }
+}
+
+int LogisticRegression::fitSecondOrder(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor,
+                                       const IterationCallback& onIteration) {
+    const size_t memory = 10; // L-BFGS correction pairs kept
+    std::vector<Eigen::VectorXd> steps, gradientChanges;
+
+    // Steps, directions and gradients all cover [weights; bias]
+    double cost = computeCost(X, y, workspace);
+    computeGradient(X, y, workspace);
+    Eigen::VectorXd gradients = parameterGradients(workspace);
+    if (isCheck(0) && !checkLoss(0, cost - regularizationCost(X.rows()), workspace, monitor)) {
+        return 0;
+    }
+
+    for (int i = 0; i < iterations; ++i) {
+        if (gradients.norm() <= tolerance) {
+            return i;
+        }
+
+        Eigen::VectorXd direction = (solver == SolverType::Newton) ? newtonDirection(X, gradients, workspace)
+                                                                    : lbfgsDirection(gradients, steps, gradientChanges);
+        if (direction.dot(gradients) >= 0) {
+            // Not a descent direction (e.g. an L1 kink); restart from steepest descent
+            direction = -gradients;
+            steps.clear();
+            gradientChanges.clear();
+        }
+
+        Eigen::VectorXd previousParameters = parameters();
+        double newCost = lineSearch(X, y, direction, cost, gradients, workspace);
+        computeGradient(X, y, workspace);
+        Eigen::VectorXd newGradients = parameterGradients(workspace);
+
+        Eigen::VectorXd step = parameters() - previousParameters;
+        Eigen::VectorXd gradientChange = newGradients - gradients;
+        if (step.dot(gradientChange) > 1e-12) {
+            if (steps.size() == memory) {
+                steps.erase(steps.begin());
+                gradientChanges.erase(gradientChanges.begin());
+            }
+            steps.push_back(step);
+            gradientChanges.push_back(gradientChange);
+        }
+
+        bool converged = std::abs(cost - newCost) <= lossTolerance(tolerance, newCost);
+        cost = newCost;
+        gradients = newGradients;
+        if (isCheck(i + 1) && !checkLoss(i + 1, cost - regularizationCost(X.rows()), workspace, monitor)) {
+            return i + 1;
+        }
+
+        if ((onIteration && !onIteration(i)) || converged) {
+            return i + 1;
+        }
+    }
+    return iterations;
+}
+
+bool LogisticRegression::checkLoss(int iteration, double trainingLoss, TrainingWorkspace& workspace, Monitor& monitor) {
+    lossHistory.iterations.push_back(iteration);
+    lossHistory.trainingLoss.push_back(trainingLoss);
+    monitor.lastCheck = iteration;
+
+    double loss = trainingLoss;
+    if (earlyStopping.validation) {
+        const DesignMatrix& validation = *earlyStopping.validation;
+        validation.multiply(weights, workspace.validationLinear);
+        loss = logisticLoss(workspace.validationLinear.data(), bias, earlyStopping.validationLabels->data(), validation.rows()) / validation.rows();
+        lossHistory.validationLoss.push_back(loss);
+    }
+
+    // Smaller but insignificant improvements still move the best parameters; patience is reset once they add up
+    // to a significant one since the last reset
+    bool improved = loss < monitor.windowLoss - lossTolerance(earlyStopping.tolerance, loss);
+    if (loss < monitor.bestLoss) {
+        monitor.bestLoss = loss;
+        lossHistory.bestIteration = iteration;
+        if (earlyStopping.validation) {
+            monitor.bestWeights = weights;
+            monitor.bestBias = bias;
+        }
     }
+    if (improved) {
+        monitor.windowLoss = monitor.bestLoss;
+    }
+    monitor.staleChecks = improved ? 0 : monitor.staleChecks + 1;
+    lossHistory.stoppedEarly = monitor.staleChecks >= earlyStopping.patience;
+    return !lossHistory.stoppedEarly;
+}
+
+void LogisticRegression::finishMonitoring(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor) {
+    if (earlyStopping.interval <= 0) {
+        return;
+    }
+    // The last parameters get a check of their own, then a validation-monitored fit goes back to its best ones.
+    // A training-loss monitor only decides when to stop, so without a validation set the last parameters are kept.
+    if (!lossHistory.stoppedEarly && monitor.lastCheck != lossHistory.iterationsRun) {
+        checkLoss(lossHistory.iterationsRun, computeCost(X, y, workspace) - regularizationCost(X.rows()), workspace, monitor);
+        lossHistory.stoppedEarly = false;
+    }
+    if (earlyStopping.validation && monitor.bestWeights.size() == weights.size()) {
+        weights = monitor.bestWeights;
+        bias = monitor.bestBias;
+    }
+}
+
+Eigen::VectorXd LogisticRegression::lbfgsDirection(const Eigen::VectorXd& gradients, const std::vector<Eigen::VectorXd>& steps,
+                                                   const std::vector<Eigen::VectorXd>& gradientChanges) const {
+    // Two-loop recursion over the stored (step, gradient change) pairs
+    const size_t count = steps.size();
+    std::vector<double> alphas(count);
+    Eigen::VectorXd q = gradients;
+
+    for (size_t k = count; k-- > 0;) {
+        alphas[k] = steps[k].dot(q) / gradientChanges[k].dot(steps[k]);
+        q -= alphas[k] * gradientChanges[k];
+    }
+
+    double scale = count > 0 ? steps.back().dot(gradientChanges.back()) / gradientChanges.back().squaredNorm()
+                             : 1.0 / std::max(1.0, gradients.norm());
+    Eigen::VectorXd r = scale * q;
+
+    for (size_t k = 0; k < count; ++k) {
+        double beta = gradientChanges[k].dot(r) / gradientChanges[k].dot(steps[k]);
+        r += (alphas[k] - beta) * steps[k];
+    }
+    return -r;
+}
+
+Eigen::VectorXd LogisticRegression::newtonDirection(const DesignMatrix& X, const Eigen::VectorXd& gradients, TrainingWorkspace& workspace) const {
+    // IRLS weights p(1-p), scaled like the mean loss
+    Eigen::VectorXd& curvature = workspace.linear;
+    X.multiply(weights, curvature);
+    sigmoid(curvature.data(), bias, curvature.data(), curvature.size());
+    curvature = curvature.array() * (1.0 - curvature.array()) / X.rows();
+
+    // Bordered by the bias row and column: [X^T S X, X^T s; s^T X, sum(s)]
+    const Eigen::Index n = X.cols();
+    Eigen::MatrixXd gram;
+    X.weightedGram(curvature, gram);
+    Eigen::VectorXd border;
+    X.transposeMultiply(curvature, border);
 
+    Eigen::MatrixXd hessian(n + 1, n + 1);
+    hessian.topLeftCorner(n, n) = gram;
+    hessian.topRightCorner(n, 1) = border;
+    hessian.bottomLeftCorner(1, n) = border.transpose();
+    hessian(n, n) = curvature.sum();
+
+    // L1 has no curvature; the small ridge keeps the system solvable when features are collinear
+    double ridge = 1e-8;
+    hessian.diagonal().array() += ridge;
+    if (regType == RegularizationType::L2) {
+        hessian.diagonal().head(n).array() += regularizationStrength / X.rows();
+    }
+
+    return hessian.ldlt().solve(-gradients);
+}
+
+double LogisticRegression::lineSearch(const DesignMatrix& X, const Eigen::VectorXd& y, const Eigen::VectorXd& direction,
+                                      double cost, const Eigen::VectorXd& gradients, TrainingWorkspace& workspace) {
+    // Backtracking until the Armijo sufficient-decrease condition holds
+    const Eigen::VectorXd start = parameters();
+    const double slope = gradients.dot(direction);
+    double stepSize = 1.0;
+    double newCost = cost;
+
+    for (int attempt = 0; attempt < 40; ++attempt) {
+        setParameters(start + stepSize * direction);
+        newCost = computeCost(X, y, workspace);
+        if (newCost <= cost + 1e-4 * stepSize * slope) {
+            return newCost;
+        }
+        stepSize *= 0.5;
+    }
+
+    setParameters(start); // no acceptable step along this direction
+    return cost;
+}
+
+Eigen::VectorXd LogisticRegression::parameters() const {
+    Eigen::VectorXd theta(weights.size() + 1);
+    theta << weights, bias;
+    return theta;
+}
+
+void LogisticRegression::setParameters(const Eigen::VectorXd& theta) {
+    weights = theta.head(theta.size() - 1);
+    bias = theta(theta.size() - 1);
+}
+
+Eigen::VectorXd LogisticRegression::parameterGradients(const TrainingWorkspace& workspace) const {
+    Eigen::VectorXd gradients(workspace.gradients.size() + 1);
+    gradients << workspace.gradients, workspace.biasGradient;
     return gradients;
 }
 
@@ -90,8 +454,45 @@ void LogisticRegression::setRegularizationStrength(double reg){
     regularizationStrength = reg;
 }
 
+void LogisticRegression::setRegularizationType(RegularizationType type){
+    regType = type;
+}
+
+void LogisticRegression::setWeights(const Eigen::VectorXd& w, double b){
+    weights = w;
+    bias = b;
+    shuffleGen.seed(seed + 1);
+    samplesSeen = 0;
+}
+
 void LogisticRegression::setThreshold(double thresh){
     threshold = thresh;
 }
 
+void LogisticRegression::setSeed(unsigned int s){
+    seed = s;
+}
+
+void LogisticRegression::setSolver(SolverType type){
+    solver = type;
+}
+
+void LogisticRegression::setBatchSize(int size){
+    batchSize = size;
+}
+
+void LogisticRegression::setTolerance(double tol){
+    tolerance = tol;
+}
+
+void LogisticRegression::setIterations(int iter){
+    iterations = iter;
+}
+
+void LogisticRegression::setWarmStart(bool enabled){
+    warmStart = enabled;
+}
 
+void LogisticRegression::setEarlyStopping(const EarlyStopping& stopping){
+    earlyStopping = stopping;
+}
@@ -3,7 +3,10 @@
 
 #include <Eigen/Dense>
 #include <vector>
-#include <QProgressDialog>
+#include <functional>
+#include <random>
+#include <limits>
+#include "designmatrix.h"
 
 enum class RegularizationType {
     None,
@@ -11,18 +14,96 @@ enum class RegularizationType {
     L2
 };
 
+enum class SolverType {
+    GradientDescent, // full-batch, one step per iteration
+    MiniBatchSGD,    // shuffled mini-batches, iterations counts epochs
+    LBFGS,           // quasi-Newton with backtracking line search; ignores learningRate
+    Newton           // IRLS: Newton steps on the exact Hessian X^T S X; ignores learningRate
+};
+
+// Buffers reused by every iteration of a fit. Sized once, so the training loop never allocates;
+// passing the same workspace to consecutive fits reuses the buffers across fits as well.
+struct TrainingWorkspace {
+    Eigen::VectorXd linear;    // X * w + b, overwritten in place by sigmoid(X * w + b) - y
+    Eigen::VectorXd labels;    // the labels of the current mini-batch, gathered next to its scores; sized by the mini-batch path
+    Eigen::VectorXd validationLinear; // validation scores of the early-stopping checks
+    std::vector<int> order;    // the row order mini-batch epochs shuffle
+    Eigen::VectorXd gradients;
+    double biasGradient = 0.0;
+
+    void reserve(Eigen::Index samples, Eigen::Index features);
+};
+
+// Loss monitoring during a fit. Every interval iterations (epochs for mini-batch SGD) the training loss and, when
+// a validation set is given, the validation loss are recorded. The fit stops once the monitored loss, the
+// validation loss if there is one and the training loss otherwise, has improved by no more than tolerance in
+// total over patience checks in a row; many small steps that add up to more keep it going. The tolerance is
+// absolute below a loss of 1 and relative to the loss above it.
+// With a validation set the fit ends on the parameters of its best check.
+struct EarlyStopping {
+    int interval = 0;        // 0 disables monitoring
+    int patience = 5;
+    double tolerance = 1e-4;
+    const DesignMatrix* validation = nullptr; // must outlive the fits
+    const Eigen::VectorXd* validationLabels = nullptr;
+};
+
+// What the last fit did, one entry per check. Losses are mean log losses without the regularization term;
+// for mini-batch SGD the training loss of a check is the running mean over the epoch before it.
+struct LossHistory {
+    std::vector<int> iterations;
+    std::vector<double> trainingLoss;
+    std::vector<double> validationLoss; // empty without a validation set
+    int iterationsRun = 0;
+    int bestIteration = 0;   // check with the lowest monitored loss
+    bool stoppedEarly = false;
+};
+
 class LogisticRegression {
 public:
     LogisticRegression(double learningRate, int iterations, double regularizationStrength, RegularizationType regType = RegularizationType::None);
 
-    void fit(const Eigen::MatrixXd& X, const Eigen::VectorXd& y, QProgressDialog& progressDialog);
+    // onIteration is called after every step with the iteration index; returning false stops the fit.
+    using IterationCallback = std::function<bool(int)>;
+
+    void fit(const Eigen::MatrixXd& X, const Eigen::VectorXd& y, const IterationCallback& onIteration);
+    void fit(const DesignMatrix& X, const Eigen::VectorXd& y, const IterationCallback& onIteration);
+    void fit(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, const IterationCallback& onIteration);
+    // Continues from the current weights with epochs shuffled mini-batch SGD passes over a new batch,
+    // whatever the configured solver. Starts from a fresh initialization if the model was never fitted.
+    void partialFit(const DesignMatrix& X, const Eigen::VectorXd& y, int epochs = 1);
+    void partialFit(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, int epochs = 1);
+    bool isFitted() const { return weights.size() > 0; }
     Eigen::VectorXd predict(const Eigen::MatrixXd& X) const;
+    Eigen::VectorXd predict(const DesignMatrix& X) const;
+    Eigen::VectorXd predictProbabilities(const DesignMatrix& X) const;
     Eigen::VectorXd getWeights() const { return weights; }
-    int singlePrediction(const Eigen::VectorXd& extendedFeatures);
+    // The intercept is a separate unregularized parameter, so designs carry no column of ones
+    double getBias() const { return bias; }
+    // Replaces the weights, e.g. with ones loaded from a model file; later partialFit calls continue from them
+    void setWeights(const Eigen::VectorXd& w, double b = 0.0);
+    int singlePrediction(const Eigen::VectorXd& features);
 
     void setLearningRate(double lr);
     void setRegularizationStrength(double reg);
+    void setRegularizationType(RegularizationType type);
     void setThreshold(double thresh);
+    void setSeed(unsigned int s);
+    void setSolver(SolverType type);
+    void setBatchSize(int size);
+    // Convergence tolerance of SGD, L-BFGS and Newton on the change in loss between steps, absolute below a loss of
+    // 1 and relative above it as for EarlyStopping; L-BFGS and Newton also stop once the gradient norm is within it
+    void setTolerance(double tol);
+    void setIterations(int iter);
+    // With warm start on, fit continues from the current weights when their size matches instead of reinitializing
+    void setWarmStart(bool enabled);
+    void setEarlyStopping(const EarlyStopping& stopping);
+    const LossHistory& getLossHistory() const { return lossHistory; }
+    int getIterations() const { return iterations; }
+    double getThreshold() const { return threshold; }
+    double getLearningRate() const { return learningRate; }
+    double getRegularizationStrength() const { return regularizationStrength; }
+    RegularizationType getRegularizationType() const { return regType; }
 
 private:
     double learningRate;
@@ -30,11 +111,58 @@ private:
     double regularizationStrength;
     double threshold;
     RegularizationType regType;
+    unsigned int seed;
+    SolverType solver;
+    int batchSize;
+    double tolerance;
+    bool warmStart;
     Eigen::VectorXd weights;
+    double bias;
+
+    // Optimizer state carried from one partialFit to the next
+    std::mt19937 shuffleGen;
+    long long samplesSeen;
+
+    EarlyStopping earlyStopping;
+    LossHistory lossHistory;
+
+    // Best parameters seen by the checks of the running fit
+    struct Monitor {
+        double bestLoss = std::numeric_limits<double>::infinity();
+        double windowLoss = std::numeric_limits<double>::infinity(); // best loss when staleChecks was last reset
+        int staleChecks = 0;
+        int lastCheck = -1;
+        Eigen::VectorXd bestWeights;
+        double bestBias = 0.0;
+    };
 
-    static double sigmoid(double z);
-    double computeCost(const Eigen::MatrixXd& X, const Eigen::VectorXd& y) const;
-    Eigen::VectorXd computeGradient(const Eigen::MatrixXd& X, const Eigen::VectorXd& y) const;
+    double computeCost(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace) const;
+    double regularizationCost(Eigen::Index samples) const;
+    // With loss set, also stores the mean log loss of the parameters the gradient is taken at
+    void computeGradient(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, double* loss = nullptr) const;
+    void initializeWeights(Eigen::Index n_features);
+    // [weights; bias] as one vector, for the solvers that step all parameters together
+    Eigen::VectorXd parameters() const;
+    void setParameters(const Eigen::VectorXd& theta);
+    Eigen::VectorXd parameterGradients(const TrainingWorkspace& workspace) const;
+    void addRegularizationGradient(Eigen::VectorXd& gradients, Eigen::Index samples) const;
+    double miniBatchEpoch(const DesignMatrix& X, const Eigen::VectorXd& y, std::vector<int>& order, TrainingWorkspace& workspace);
+    // Each returns the iterations it ran
+    int fitGradientDescent(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor,
+                           const IterationCallback& onIteration);
+    int fitMiniBatch(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor,
+                     const IterationCallback& onIteration);
+    int fitSecondOrder(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor,
+                       const IterationCallback& onIteration);
+    bool isCheck(int iteration) const { return earlyStopping.interval > 0 && iteration % earlyStopping.interval == 0; }
+    // Records a check at the current parameters; false once the fit should stop
+    bool checkLoss(int iteration, double trainingLoss, TrainingWorkspace& workspace, Monitor& monitor);
+    void finishMonitoring(const DesignMatrix& X, const Eigen::VectorXd& y, TrainingWorkspace& workspace, Monitor& monitor);
+    Eigen::VectorXd lbfgsDirection(const Eigen::VectorXd& gradients, const std::vector<Eigen::VectorXd>& steps,
+                                   const std::vector<Eigen::VectorXd>& gradientChanges) const;
+    Eigen::VectorXd newtonDirection(const DesignMatrix& X, const Eigen::VectorXd& gradients, TrainingWorkspace& workspace) const;
+    double lineSearch(const DesignMatrix& X, const Eigen::VectorXd& y, const Eigen::VectorXd& direction,
+                      double cost, const Eigen::VectorXd& gradients, TrainingWorkspace& workspace);
 };
 
 #endif // LOGISTICREGRESSION_H
@@ -1,10 +1,18 @@
-#include "MachineLearning.h"
+#include "machinelearning.h"
+#include "quantizeddesign.h"
+#include "datasetcache.h"
+#include "csvparser.h"
+#include "modelfile.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <algorithm>
 #include <random>
+#include <numeric>
+#include <cmath>
 #include <iomanip> // for std::setw
+#include <atomic>
+#include <chrono>
 
 
 
@@ -13,63 +21,217 @@
 #define LEARNING_RATE 0.1
 #define ITERATIONS 5000
 #define REGULARIZATION_MODIFIER 0.001
+#define PATH_WARM_ITERATIONS (ITERATIONS / 5) // budget of each warm-started fit after the first on a path
+#define CROSS_VALIDATION_FOLDS 5
+#define FOLD_SEED 7 // folds are fixed for a given training split, so every configuration sees the same ones
+#define EARLY_STOPPING_INTERVAL 10 // iterations between loss checks
+#define EARLY_STOPPING_PATIENCE 5
+#define EARLY_STOPPING_TOLERANCE 1e-4 // loss improvement over the patience window at LEARNING_RATE; see EarlyStopping
 
 MachineLearning::MachineLearning(const std::string& datasetPath)
-    : path(datasetPath), model(LEARNING_RATE, ITERATIONS, REGULARIZATION_MODIFIER, RegularizationType::L1) {}
+    : path(datasetPath), featureStorage(FeatureStorage::Diagram), featureEncoding(FeatureEncoding::Grid), solver(SolverType::GradientDescent), crossValidationFolds(CROSS_VALIDATION_FOLDS), earlyStoppingPatience(EARLY_STOPPING_PATIENCE), model(LEARNING_RATE, ITERATIONS, REGULARIZATION_MODIFIER, RegularizationType::L1), pool(std::make_unique<ThreadPool>()) {}
+
+bool MachineLearning::loadDataset() {
+    // A binary cache that still matches the CSV skips parsing entirely
+    sampleDiagrams.clear();
+    if (!readDatasetCache(path, sampleDiagrams, sampleLabels)) {
+        parseDataset(sampleDiagrams, sampleLabels);
+        writeDatasetCache(path, sampleDiagrams, sampleLabels);
+    }
 
-void MachineLearning::loadDataset() {
-    std::ifstream file(path);
-    std::string line;
-    std::vector<Eigen::VectorXd> temp_data;
-    std::vector<int> temp_labels;
+    // Split the dataset
+    splitDataset();
+    return !sampleDiagrams.empty();
+}
 
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string cell;
-        std::vector<std::string> row;
+void MachineLearning::addSamples(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& labels) {
+    const size_t first = sampleDiagrams.size();
+    sampleDiagrams.insert(sampleDiagrams.end(), diagrams.begin(), diagrams.end());
+    sampleLabels.conservativeResize(sampleDiagrams.size());
+    sampleLabels.tail(labels.size()) = labels;
 
-        while (std::getline(ss, cell, ',')) {
-            row.push_back(cell);
-        }
+    // Only the new rows are dealt out, so no row the model has trained on can move to the test split
+    const size_t trainBefore = trainRows.size();
+    splitRows(first);
+    addedTrainRows.assign(trainRows.begin() + trainBefore, trainRows.end());
+}
 
-        auto [features, label] = processRow(row);
-        temp_data.push_back(features);
-        temp_labels.push_back(label);
+void MachineLearning::partialTrain() {
+    if (addedTrainRows.empty()) {
+        return;
     }
+    Eigen::VectorXd labels(addedTrainRows.size());
+    for (size_t i = 0; i < addedTrainRows.size(); ++i) {
+        labels(i) = sampleLabels(addedTrainRows[i]);
+    }
+    model.partialFit(RowSubsetDesign(*sampleDesign, addedTrainRows), labels);
+    reportIncrementalAccuracy(addedTrainRows.size());
+    addedTrainRows.clear();
+}
 
-    // Convert vectors to Eigen matrix and vector
-    int num_samples = temp_data.size();
-    int num_features = temp_data.front().size();
-    Eigen::MatrixXd data(num_samples, num_features);
-    Eigen::VectorXd labels(num_samples);
+void MachineLearning::partialTrain(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& labels) {
+    model.partialFit(*featureEncoder(featureEncoding).design(diagrams), labels);
+    reportIncrementalAccuracy(diagrams.size());
+}
 
-    for (int i = 0; i < num_samples; ++i) {
-        data.row(i) = temp_data[i];
-        labels(i) = temp_labels[i];
+void MachineLearning::reportIncrementalAccuracy(size_t samples) const {
+    // Nothing to score before a dataset is loaded
+    if (!testDesign || y_test.size() == 0) {
+        return;
     }
+    std::cout << "Accuracy after incremental update on " << samples << " samples: "
+              << evaluateAccuracy(model.predict(ParallelDesign(*testDesign, *pool)), y_test) << std::endl;
+}
 
-    // Split the dataset
-    splitDataset(data, labels);
+void MachineLearning::parseDataset(std::vector<Diagram>& temp_data, Eigen::VectorXd& labels) {
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    if (!parseDiagramCsv(path, *pool, temp_data, labels, errors, stats)) {
+        std::cerr << "Error: could not open " << path << std::endl;
+        temp_data.clear();
+        labels.resize(0);
+        return;
+    }
+
+    const size_t maxReported = 10;
+    for (size_t i = 0; i < errors.size() && i < maxReported; ++i) {
+        std::cerr << path << ":" << errors[i].line << ": skipped malformed row (" << errors[i].message << ")" << std::endl;
+    }
+    if (errors.size() > maxReported) {
+        std::cerr << "... and " << errors.size() - maxReported << " more malformed rows" << std::endl;
+    }
+
+    std::cout << "Parsed " << stats.rows << " rows (" << stats.bytes / 1e6 << " MB) in " << stats.seconds * 1000
+              << " ms, " << stats.megabytesPerSecond() << " MB/s" << std::endl;
 }
 
-void MachineLearning::addIntercept(Eigen::MatrixXd& X) {
-    Eigen::MatrixXd newX(X.rows(), X.cols() + 1);
-    newX << Eigen::VectorXd::Ones(X.rows()), X;
-    X = newX;
+bool MachineLearning::saveModel(const std::string& modelPath) const {
+    if (!::saveModel(modelPath, model, featureEncoding)) {
+        std::cerr << "Error: could not save the model to " << modelPath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool MachineLearning::loadModel(const std::string& modelPath) {
+    std::string error;
+    FeatureEncoding encoding;
+    LogisticRegression loaded = model;
+    if (!::loadModel(modelPath, loaded, encoding, error)) {
+        std::cerr << "Model " << modelPath << " not loaded: " << error << std::endl;
+        return false;
+    }
+    setFeatureEncoding(encoding);
+    model = loaded;
+    std::cout << "Loaded model " << modelPath << " (" << featureEncoder(encoding).name() << " features, threshold "
+              << model.getThreshold() << ")" << std::endl;
+    return true;
+}
+
+void MachineLearning::setFeatureStorage(FeatureStorage storage) {
+    featureStorage = storage;
+    buildDesigns();
+    buildSplitViews();
+}
+
+void MachineLearning::setFeatureEncoding(FeatureEncoding encoding) {
+    if (encoding == featureEncoding) {
+        return;
+    }
+    // Weights for one encoding mean nothing under another, so the trained model goes too
+    featureEncoding = encoding;
+    model.setWeights(Eigen::VectorXd());
+    buildDesigns();
+    buildSplitViews();
+}
+
+void MachineLearning::setSolver(SolverType type) {
+    solver = type;
+    model.setSolver(type);
+}
+
+void MachineLearning::setCrossValidationFolds(int folds) {
+    crossValidationFolds = folds;
+}
+
+void MachineLearning::setEarlyStoppingPatience(int checks) {
+    earlyStoppingPatience = checks;
+}
+
+void MachineLearning::setThreadCount(size_t threads) {
+    pool = threads > 0 ? std::make_unique<ThreadPool>(threads) : std::make_unique<ThreadPool>();
+}
+
+namespace {
+
+// A gradient step changes the loss in proportion to the learning rate, so slower rates get a finer tolerance and
+// are not stopped while still descending; L-BFGS and Newton steps do not use the rate
+EarlyStopping earlyStopping(SolverType solver, int patience, double learningRate) {
+    EarlyStopping stopping;
+    stopping.interval = patience > 0 ? EARLY_STOPPING_INTERVAL : 0;
+    stopping.patience = patience;
+    if (solver == SolverType::GradientDescent || solver == SolverType::MiniBatchSGD) {
+        stopping.tolerance = EARLY_STOPPING_TOLERANCE * std::min(1.0, learningRate / LEARNING_RATE);
+    } else {
+        stopping.tolerance = EARLY_STOPPING_TOLERANCE;
+    }
+    return stopping;
+}
+
+template <typename Cell>
+std::unique_ptr<DesignMatrix> quantizedDesign(const std::vector<Diagram>& diagrams, const FeatureEncoder& encoder) {
+    auto design = std::make_unique<QuantizedDesign<Cell>>(diagrams.size(), encoder.featureCount());
+    for (size_t i = 0; i < diagrams.size(); ++i) {
+        design->setRow(i, encoder.encode(diagrams[i]));
+    }
+    return design;
+}
+
+}
+
+void MachineLearning::buildDesigns() {
+    // The views refer to the old design, so they go first
+    trainDesign.reset();
+    testDesign.reset();
+
+    // The double matrix is only kept for FeatureStorage::Dense
+    sampleFeatures.resize(0, 0);
+
+    const FeatureEncoder& encoder = featureEncoder(featureEncoding);
+    switch (featureStorage) {
+    case FeatureStorage::Diagram:
+        sampleDesign = encoder.design(sampleDiagrams);
+        break;
+    case FeatureStorage::Uint8:
+        sampleDesign = quantizedDesign<uint8_t>(sampleDiagrams, encoder);
+        break;
+    case FeatureStorage::Float32:
+        sampleDesign = quantizedDesign<float>(sampleDiagrams, encoder);
+        break;
+    case FeatureStorage::Dense:
+        sampleFeatures.resize(sampleDiagrams.size(), encoder.featureCount());
+        for (size_t i = 0; i < sampleDiagrams.size(); ++i) {
+            sampleFeatures.row(i) = encoder.encode(sampleDiagrams[i]);
+        }
+        sampleDesign = std::make_unique<DenseDesign>(sampleFeatures);
+        break;
+    }
+}
+
+void MachineLearning::buildSplitViews() {
+    trainDesign = std::make_unique<RowSubsetDesign>(*sampleDesign, trainRows);
+    testDesign = std::make_unique<RowSubsetDesign>(*sampleDesign, testRows);
 }
 
 void printMatrix(const Eigen::MatrixXd& matrix, const std::string& matrixName) {
     std::cout << "Contents of " << matrixName << ":" << std::endl;
     for (int i = 0; i < 1; ++i) {
-        // Print the leading 1
-        std::cout << std::setw(3) << matrix(i, 0) << std::endl;
-
-        // Print the remaining elements in groups of 20
-        for (int j = 1; j < matrix.cols(); ++j) {
+        // Print the elements in groups of 20
+        for (int j = 0; j < matrix.cols(); ++j) {
             std::cout << std::setw(3) << matrix(i, j) << " ";
 
-            // After every 20 elements (starting from the second element), insert a line break
-            if ((j - 1) % 20 == 19)
+            // After every 20 elements, insert a line break
+            if (j % 20 == 19)
                 std::cout << std::endl;
         }
         std::cout << std::endl; // Extra line break after each row of the matrix
@@ -78,103 +240,337 @@ void printMatrix(const Eigen::MatrixXd& matrix, const std::string& matrixName) {
 
 }
 
-void MachineLearning::train(QProgressDialog& progressDialog) {
+bool MachineLearning::train(const ProgressCallback& onProgress, const CancellationToken* cancel) {
+    if (y_train.size() == 0) {
+        std::cerr << "Error: no training rows in " << path << std::endl;
+        return false;
+    }
+
     std::vector<double> learningRates = {0.1, 0.01, 0.001, 0.0001};
     std::vector<double> regularizationModifiers = {0.01, 0.1, 100, 300, 500, 700, 1000};
-    std::vector<double> thresholds = {0.1, 0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 0.9};
 
     double bestAccuracy = 0.0;
     double bestLearningRate = 0.0;
     double bestRegularizationModifier = 0.0;
     double bestThreshold = 0.0;
 
-    for (double thresh : thresholds) {
-        for (double lr : learningRates) {
-            for (double reg : regularizationModifiers) {
-                model.setLearningRate(lr);
-                model.setRegularizationStrength(reg);
-                model.setThreshold(thresh);
-
-                // Train the model
-                model.fit(X_train, y_train, progressDialog);
-
-                // Evaluate the model (you might need a validation set for this)
-                double accuracy = test(lr, reg, thresh); // Ensure this function is updated to use the current threshold
-
-                // Update the best parameters
-                if (accuracy > bestAccuracy) {
-                    bestAccuracy = accuracy;
-                    bestLearningRate = lr;
-                    bestRegularizationModifier = reg;
-                    bestThreshold = thresh;
+    // The search accounts for this share of the reported progress, the final fit for the rest
+    const double searchShare = 0.9;
+    std::vector<SearchResult> results = gridSearch(learningRates, regularizationModifiers, onProgress, cancel, searchShare);
+    if (cancel && cancel->isCanceled()) {
+        return false;
+    }
+
+    // The threshold is no longer a grid axis: each fit is scored once and every cutoff is swept over the scores.
+    // Results come back in grid order, so the reduction picks the same winner as a serial loop would.
+    for (const SearchResult& result : results) {
+        std::cout << "Accuracy: " << result.accuracy << " +/- " << result.accuracyStd
+                  << " with learning rate: " << result.learningRate
+                  << ", regularization modifier: " << result.regularization
+                  << ", and threshold: " << result.threshold
+                  << " (ROC AUC " << result.rocAuc << ", " << result.iterations << " iterations)" << std::endl;
+
+        // Update the best parameters
+        if (result.accuracy > bestAccuracy) {
+            bestAccuracy = result.accuracy;
+            bestLearningRate = result.learningRate;
+            bestRegularizationModifier = result.regularization;
+            bestThreshold = result.threshold;
+        }
+    }
+
+    // Train final model with best hyperparameters and threshold; it only replaces the current model once complete
+    LogisticRegression candidate = model;
+    candidate.setLearningRate(bestLearningRate);
+    candidate.setRegularizationStrength(bestRegularizationModifier);
+    candidate.setThreshold(bestThreshold);
+    candidate.setEarlyStopping(earlyStopping(solver, earlyStoppingPatience, bestLearningRate));
+    // The grid search already keeps every thread busy with whole fits; the final fit spreads its products instead
+    candidate.fit(ParallelDesign(*trainDesign, *pool), y_train, [&](int i) {
+        if (onProgress && i % 64 == 0) {
+            onProgress(searchShare + (1.0 - searchShare) * i / ITERATIONS);
+        }
+        return !(cancel && cancel->isCanceled());
+    });
+    if (cancel && cancel->isCanceled()) {
+        return false;
+    }
+
+    model = candidate;
+    test(bestLearningRate, bestRegularizationModifier, bestThreshold); // Ensure this function uses the best threshold
+    return true;
+}
+
+std::vector<MachineLearning::SearchResult> MachineLearning::gridSearch(const std::vector<double>& learningRates,
+                                                                       const std::vector<double>& regularizationModifiers,
+                                                                       const ProgressCallback& onProgress,
+                                                                       const CancellationToken* cancel, double progressShare) {
+    // Selecting on the test split would make the reported test accuracy optimistic; folds of the training split do not
+    if (crossValidationFolds >= 2 && y_train.size() >= crossValidationFolds) {
+        return crossValidate(learningRates, regularizationModifiers, crossValidationFolds, onProgress, cancel, progressShare);
+    }
+    Split holdout = {trainDesign.get(), &y_train, testDesign.get(), &y_test, true};
+    return searchSplits({holdout}, learningRates, regularizationModifiers, onProgress, cancel, progressShare);
+}
+
+std::vector<MachineLearning::SearchResult> MachineLearning::crossValidate(const std::vector<double>& learningRates,
+                                                                          const std::vector<double>& regularizationModifiers,
+                                                                          int folds, const ProgressCallback& onProgress,
+                                                                          const CancellationToken* cancel, double progressShare) {
+    // Shuffle the training rows once and deal them into folds; each fold validates a model trained on the others.
+    // The folds index the sample store directly rather than stacking a view on the training view.
+    const int samples = static_cast<int>(trainRows.size());
+    std::vector<int> order = trainRows;
+    std::mt19937 gen(FOLD_SEED);
+    std::shuffle(order.begin(), order.end(), gen);
+
+    std::vector<std::unique_ptr<RowSubsetDesign>> views;
+    std::vector<Eigen::VectorXd> labels;
+    views.reserve(2 * folds);
+    labels.reserve(2 * folds);
+    for (int fold = 0; fold < folds; ++fold) {
+        const int begin = static_cast<int>(static_cast<long long>(samples) * fold / folds);
+        const int end = static_cast<int>(static_cast<long long>(samples) * (fold + 1) / folds);
+        std::vector<int> foldTrainRows(order.begin(), order.begin() + begin);
+        foldTrainRows.insert(foldTrainRows.end(), order.begin() + end, order.end());
+        std::vector<int> validationRows(order.begin() + begin, order.begin() + end);
+
+        // Ascending row order keeps the walk over the shared samples sequential
+        for (std::vector<int>* rows : {&foldTrainRows, &validationRows}) {
+            std::sort(rows->begin(), rows->end());
+            Eigen::VectorXd y(rows->size());
+            for (size_t i = 0; i < rows->size(); ++i) {
+                y(i) = sampleLabels((*rows)[i]);
+            }
+            labels.push_back(std::move(y));
+            views.push_back(std::make_unique<RowSubsetDesign>(*sampleDesign, std::move(*rows)));
+        }
+    }
+
+    std::vector<Split> splits;
+    for (int fold = 0; fold < folds; ++fold) {
+        splits.push_back({views[2 * fold].get(), &labels[2 * fold], views[2 * fold + 1].get(), &labels[2 * fold + 1], false});
+    }
+    return searchSplits(splits, learningRates, regularizationModifiers, onProgress, cancel, progressShare);
+}
+
+std::vector<MachineLearning::SearchResult> MachineLearning::searchSplits(const std::vector<Split>& splits,
+                                                                         const std::vector<double>& learningRates,
+                                                                         const std::vector<double>& regularizationModifiers,
+                                                                         const ProgressCallback& onProgress,
+                                                                         const CancellationToken* cancel, double progressShare) {
+    const size_t pathLength = regularizationModifiers.size();
+    const size_t splitCount = splits.size();
+
+    // Validation scores and summaries in slot (lr * pathLength + reg) * splitCount + split, filled by the tasks in any order
+    const size_t slotCount = learningRates.size() * pathLength * splitCount;
+    std::vector<Eigen::VectorXd> probabilities(slotCount);
+    std::vector<double> rocAucs(slotCount);
+    std::vector<double> trainingCutoffs(slotCount);
+    std::vector<int> iterationsRun(slotCount);
+
+    // One task per (learning rate, split) walks the whole regularization path, so only its first fit starts cold.
+    // Workers only read the designs and labels and write to their own slots.
+    // Progress from every fit is summed into one counter that the calling thread polls.
+    std::atomic<long long> completedIterations(0);
+    const long long pathIterations = ITERATIONS + static_cast<long long>(pathLength - 1) * PATH_WARM_ITERATIONS;
+    std::vector<std::future<void>> pending;
+    pending.reserve(learningRates.size() * splitCount);
+
+    for (size_t lr = 0; lr < learningRates.size(); ++lr) {
+        for (size_t split = 0; split < splitCount; ++split) {
+            pending.push_back(pool->submit([&, lr, split]() {
+                long long counted = 0;
+                RegularizationPath path = regularizationPath(learningRates[lr], regularizationModifiers, splits[split], [&](int) {
+                    completedIterations.fetch_add(1, std::memory_order_relaxed);
+                    ++counted;
+                    return !(cancel && cancel->isCanceled());
+                });
+                // Iterations saved by stopping early count as done
+                completedIterations.fetch_add(pathIterations - counted, std::memory_order_relaxed);
+
+                // The path is ordered strongest first; put each fit's results back in its grid slot
+                for (size_t i = 0; i < path.strengths.size(); ++i) {
+                    const size_t slot = (lr * pathLength + path.slots[i]) * splitCount + split;
+                    probabilities[slot] = std::move(path.probabilities[i]);
+                    rocAucs[slot] = path.evaluations[i].rocAuc;
+                    iterationsRun[slot] = path.histories[i].iterationsRun;
+                    // Test rows are only scored: the holdout threshold is swept over the training rows instead
+                    if (splits[split].validationIsTest) {
+                        LogisticRegression fitted(learningRates[lr], 0, path.strengths[i]);
+                        fitted.setWeights(path.weights[i], path.biases[i]);
+                        trainingCutoffs[slot] = evaluateProbabilities(fitted.predictProbabilities(*splits[split].train),
+                                                                      *splits[split].trainLabels).best.threshold;
+                    }
                 }
+            }));
+        }
+    }
+
+    const long long totalIterations = static_cast<long long>(pending.size()) * pathIterations;
+
+    for (auto& task : pending) {
+        while (task.wait_for(std::chrono::milliseconds(50)) != std::future_status::ready) {
+            if (onProgress) {
+                onProgress(progressShare * completedIterations.load() / totalIterations);
             }
         }
+        task.get();
     }
 
-    // Train final model with best hyperparameters and threshold
-    model.setLearningRate(bestLearningRate);
-    model.setRegularizationStrength(bestRegularizationModifier);
-    model.setThreshold(bestThreshold);
-    model.fit(X_train, y_train, progressDialog);
-    test(bestLearningRate, bestRegularizationModifier, bestThreshold); // Ensure this function uses the best threshold
+    // One cutoff per configuration, shared by every split, so the accuracy reported is that of the threshold the final
+    // model gets. Folds pick it on their pooled out-of-fold scores, the holdout split (there is only one) on its
+    // training rows. Then mean and spread over the splits, in grid order.
+    std::vector<SearchResult> results;
+    std::vector<double> accuracies(splitCount);
+    for (size_t lr = 0; lr < learningRates.size(); ++lr) {
+        for (size_t reg = 0; reg < pathLength; ++reg) {
+            const size_t first = (lr * pathLength + reg) * splitCount;
+            SearchResult result = {learningRates[lr], regularizationModifiers[reg], 0.0, 0.0, 0.0, 0.0, 0.0};
+            if (splits.front().validationIsTest) {
+                result.threshold = trainingCutoffs[first];
+            } else {
+                Eigen::Index pooledRows = 0;
+                for (size_t split = 0; split < splitCount; ++split) {
+                    pooledRows += probabilities[first + split].size();
+                }
+                Eigen::VectorXd pooled(pooledRows), pooledLabels(pooledRows);
+                Eigen::Index offset = 0;
+                for (size_t split = 0; split < splitCount; ++split) {
+                    const Eigen::Index rows = probabilities[first + split].size();
+                    pooled.segment(offset, rows) = probabilities[first + split];
+                    pooledLabels.segment(offset, rows) = *splits[split].validationLabels;
+                    offset += rows;
+                }
+                result.threshold = evaluateProbabilities(pooled, pooledLabels).best.threshold;
+            }
+
+            for (size_t split = 0; split < splitCount; ++split) {
+                const Eigen::VectorXd& scores = probabilities[first + split];
+                const Eigen::VectorXd predictions = (scores.array() > result.threshold).cast<double>();
+                accuracies[split] = scores.size() > 0 ? evaluateAccuracy(predictions, *splits[split].validationLabels) : 0.0;
+                result.iterations += static_cast<double>(iterationsRun[first + split]) / splitCount;
+                result.accuracy += accuracies[split] / splitCount;
+                result.rocAuc += rocAucs[first + split] / splitCount;
+            }
+            if (splitCount > 1) {
+                double squares = 0.0;
+                for (size_t split = 0; split < splitCount; ++split) {
+                    squares += (accuracies[split] - result.accuracy) * (accuracies[split] - result.accuracy);
+                }
+                result.accuracyStd = std::sqrt(squares / (splitCount - 1));
+            }
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+MachineLearning::RegularizationPath MachineLearning::regularizationPath(double learningRate, std::vector<double> strengths,
+                                                                        const LogisticRegression::IterationCallback& onIteration) const {
+    Split holdout = {trainDesign.get(), &y_train, testDesign.get(), &y_test, true};
+    return regularizationPath(learningRate, std::move(strengths), holdout, onIteration);
 }
 
+MachineLearning::RegularizationPath MachineLearning::regularizationPath(double learningRate, std::vector<double> strengths, const Split& split,
+                                                                        const LogisticRegression::IterationCallback& onIteration) const {
+    RegularizationPath path;
+    path.learningRate = learningRate;
+    // Sort positions rather than values, so equal strengths keep their own slots
+    std::vector<size_t> order(strengths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return strengths[a] > strengths[b]; });
+
+    // Strong regularization gives the simplest model; each weaker strength only refines the previous
+    // solution, so after the first cold fit the rest get a smaller iteration budget
+    LogisticRegression candidate(learningRate, ITERATIONS, order.empty() ? 0.0 : strengths[order.front()], RegularizationType::L1);
+    candidate.setSolver(solver);
+    candidate.setWarmStart(true);
+    // Each fit stops once the loss on the rows it is scored on stops improving, and keeps its best parameters there;
+    // test rows are never watched, since that would tune the fit to the rows its accuracy is reported on
+    EarlyStopping stopping = earlyStopping(solver, earlyStoppingPatience, learningRate);
+    if (!split.validationIsTest) {
+        stopping.validation = split.validation;
+        stopping.validationLabels = split.validationLabels;
+    }
+    candidate.setEarlyStopping(stopping);
+
+    // Each pool thread keeps one workspace and reuses it for every fit it runs
+    thread_local TrainingWorkspace workspace;
+    for (size_t slot : order) {
+        const double strength = strengths[slot];
+        candidate.setRegularizationStrength(strength);
+        candidate.fit(*split.train, *split.trainLabels, workspace, onIteration);
+        candidate.setIterations(PATH_WARM_ITERATIONS);
+
+        path.strengths.push_back(strength);
+        path.slots.push_back(slot);
+        path.weights.push_back(candidate.getWeights());
+        path.biases.push_back(candidate.getBias());
+        Eigen::VectorXd probabilities = candidate.predictProbabilities(*split.validation);
+        path.evaluations.push_back(evaluateProbabilities(probabilities, *split.validationLabels));
+        path.probabilities.push_back(std::move(probabilities));
+        path.histories.push_back(candidate.getLossHistory());
+    }
+    return path;
+}
 
 int MachineLearning::predict(const std::string& diagram) {
     // Parse the input string to extract color and position information
     std::istringstream ss(diagram);
     std::string token;
-    //Eigen::VectorXd color_order(4); // Assuming there are 4 color wires
-    std::array<std::array<double, 20>, 20> matrix = {};
+    std::vector<Diagram> sample(1);
 
-    int colorOrderIndex = 0;
     while (std::getline(ss, token, ',')) {
         std::istringstream tokenStream(token);
         std::string rowOrCol, color;
         int index;
         tokenStream >> rowOrCol >> index >> color;
 
-        // Convert color to a numerical value
-        double colorValue = encodeColor(color);
-        //color_order[colorOrderIndex++] = colorValue;
-
-        // Calculate position in the flattened matrix
-        int position = (rowOrCol == "Row") ? index : index;
-        if (rowOrCol == "Row") {
-            std::fill(matrix[position].begin(), matrix[position].end(), colorValue);
-        } else {
-            for (auto& row : matrix) {
-                row[position] = colorValue;
-            }
-        }
+        // StartWidget already reports 0-based positions
+        sample[0].addWire(rowOrCol == "Row", index, encodeColor(color));
     }
 
-    // Flatten the matrix and append color order
-    Eigen::VectorXd feature_vector(400); //+ color_order.size() 400 for flattened matrix + size of color_order
-    int index = 0;
+    // Make a prediction
+    return static_cast<int>(model.predict(*featureEncoder(featureEncoding).design(sample))(0));
+}
 
-    for (const auto& row : matrix) {
-        for (double value : row) {
-            feature_vector(index++) = value;
-        }
+bool MachineLearning::score(const std::vector<Diagram>& diagrams, ScoreSink& sink) {
+    if (!model.isFitted()) {
+        std::cerr << "Error: no trained model to score with" << std::endl;
+        return false;
     }
-    //feature_vector.segment(400, color_order.size()) = color_order;
+    return scoreDiagrams(model, featureEncoder(featureEncoding), diagrams.data(), diagrams.size(), *pool, sink);
+}
 
-    // Add an intercept term
-    Eigen::VectorXd extendedFeatures(1 + feature_vector.size());
-    extendedFeatures << 1, feature_vector;
-    std::cout << "Shape of X_predict: " << extendedFeatures.size() << std::endl;
-    // Make a prediction
-    int prediction = model.singlePrediction(extendedFeatures);
+bool MachineLearning::scoreFile(const std::string& inputPath, const std::string& outputPath) {
+    if (!model.isFitted()) {
+        std::cerr << "Error: no trained model to score with" << std::endl;
+        return false;
+    }
+    CsvScoreSink sink(outputPath);
+    if (!sink.isOpen()) {
+        std::cerr << "Error: could not create " << outputPath << std::endl;
+        return false;
+    }
 
-    // Assuming a binary classification and threshold of 0.5
-    return prediction;
-}
+    std::vector<CsvParseError> errors;
+    CsvParseStats stats;
+    if (!scoreDiagramCsv(model, featureEncoder(featureEncoding), inputPath, *pool, sink, errors, stats)) {
+        std::cerr << "Error: could not open " << inputPath << std::endl;
+        return false;
+    }
 
+    for (size_t i = 0; i < errors.size() && i < 10; ++i) {
+        std::cerr << inputPath << ":" << errors[i].line << ": malformed row, written as Unscored (" << errors[i].message << ")" << std::endl;
+    }
+    std::cout << "Scored " << stats.rows << " rows in " << stats.seconds * 1000 << " ms, "
+              << (stats.seconds > 0 ? stats.rows / stats.seconds : 0.0) << " rows/s" << std::endl;
+    return true;
+}
 
 double MachineLearning::test(double lr, double reg, double thresh) {
-    auto predictions = model.predict(X_test);
+    auto predictions = model.predict(ParallelDesign(*testDesign, *pool));
     double accuracy = evaluateAccuracy(predictions, y_test);
 
     // Updated print statement to include the threshold
@@ -183,9 +579,18 @@ double MachineLearning::test(double lr, double reg, double thresh) {
               << ", regularization modifier: " << reg
               << ", and threshold: " << thresh << std::endl;
 
+    EvaluationReport report = evaluate();
+    std::cout << "ROC AUC: " << report.rocAuc << ", average precision: " << report.averagePrecision
+              << ", best threshold on the test set: " << report.best.threshold
+              << " (accuracy " << report.best.accuracy << ", F1 " << report.best.f1 << ")" << std::endl;
+
     return accuracy;
 }
 
+EvaluationReport MachineLearning::evaluate() const {
+    return evaluateProbabilities(model.predictProbabilities(ParallelDesign(*testDesign, *pool)), y_test);
+}
+
 
 
 
@@ -206,91 +611,44 @@ double MachineLearning::evaluateAccuracy(const Eigen::VectorXd& predictions, con
 }
 
 
-int MachineLearning::encodeColor(const std::string& color) {
-    if (color == "Red") return 1;
-    if (color == "Green") return 2;
-    if (color == "Yellow") return 3;
-    if (color == "Blue") return 4;
-    return 0;
-}
-
-std::pair<Eigen::VectorXd, int> MachineLearning::processRow(const std::vector<std::string>& row) {
-    std::array<std::array<double, 20>, 20> matrix = {};
-    //Eigen::VectorXd color_order(row.size() - 1); // Assuming color_order should be of size row.size() - 1
-    int label = (row.back().find("Dangerous") != std::string::npos) ? 1 : 0;
-
-    for (size_t i = 0; i < row.size() - 1; ++i) {
-        std::stringstream ss(row[i]);
-        std::string part;
-        std::vector<std::string> parts;
-
-        while (std::getline(ss, part, ' ')) {
-            parts.push_back(part);
-        }
-
-        int position = std::stoi(parts[1]) - 1;
-        int color = encodeColor(parts[2]);
-        //color_order[i] = color; // Using Eigen vector for color_order
-
-        if (parts[0] == "Row") {
-            std::fill(matrix[position].begin(), matrix[position].end(), color);
-        } else {
-            for (auto& row : matrix) {
-                row[position] = color;
-            }
-        }
-    }
-
-    // Flatten the matrix and append color order
-    Eigen::VectorXd feature_vector(400); // + color_order.size()400 for flattened matrix + size of color_order
-    int index = 0;
-
-    for (const auto& row : matrix) {
-        for (double value : row) {
-            feature_vector(index++) = value;
-        }
-    }
-
-    // Append color order to feature vector
-    // feature_vector.segment(400, color_order.size()) = color_order;
-
-    // Return a pair of feature vector and label
-    return std::make_pair(feature_vector, label);
+void MachineLearning::splitDataset() {
+    trainRows.clear();
+    testRows.clear();
+    addedTrainRows.clear();
+    splitRows(0);
 }
 
-void MachineLearning::splitDataset(Eigen::MatrixXd& data, Eigen::VectorXd& labels) {
-    int num_samples = data.rows();
-    int train_size = static_cast<int>(num_samples * 0.8);
-    int test_size = num_samples - train_size;
+void MachineLearning::splitRows(size_t first) {
+    const int num_samples = static_cast<int>(sampleDiagrams.size() - first);
+    const int train_size = static_cast<int>(num_samples * 0.8);
 
-    // Shuffle the dataset
+    // Shuffle the rows from first on
     std::vector<int> indices(num_samples);
-    std::iota(indices.begin(), indices.end(), 0);
+    std::iota(indices.begin(), indices.end(), static_cast<int>(first));
     std::random_device rd;
     std::mt19937 g(rd());
     std::shuffle(indices.begin(), indices.end(), g);
 
-    // Split the dataset
-    X_train.resize(train_size, data.cols());
-    y_train.resize(train_size);
-    X_test.resize(test_size, data.cols());
-    y_test.resize(test_size);
-
-    for (int i = 0; i < train_size; ++i) {
-        X_train.row(i) = data.row(indices[i]);
-        y_train(i) = labels(indices[i]);
+    // Split the indices, not the samples; every new index is above the old ones, so sorting the new ones alone
+    // keeps each split ascending, which keeps the views' walks sequential
+    const size_t trainBefore = trainRows.size();
+    const size_t testBefore = testRows.size();
+    trainRows.insert(trainRows.end(), indices.begin(), indices.begin() + train_size);
+    testRows.insert(testRows.end(), indices.begin() + train_size, indices.end());
+    std::sort(trainRows.begin() + trainBefore, trainRows.end());
+    std::sort(testRows.begin() + testBefore, testRows.end());
+
+    // Only the labels are gathered, one double per sample
+    y_train.resize(trainRows.size());
+    for (size_t i = 0; i < trainRows.size(); ++i) {
+        y_train(i) = sampleLabels(trainRows[i]);
     }
-
-    for (int i = 0; i < test_size; ++i) {
-        X_test.row(i) = data.row(indices[train_size + i]);
-        y_test(i) = labels(indices[train_size + i]);
+    y_test.resize(testRows.size());
+    for (size_t i = 0; i < testRows.size(); ++i) {
+        y_test(i) = sampleLabels(testRows[i]);
     }
 
-    addIntercept(X_train);
-    addIntercept(X_test);
+    // The sample store may have moved, so the designs over it are rebuilt
+    buildDesigns();
+    buildSplitViews();
 }
-
-
-
-
-
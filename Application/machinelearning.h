@@ -3,31 +3,156 @@
 
 #include <Eigen/Dense>
 #include <string>
-#include <QProgressDialog>
+#include <memory>
 
 #include "logisticregression.h"
+#include "threadpool.h"
+#include "evaluation.h"
+#include "inference.h"
+#include "progress.h"
+#include "featureencoder.h"
+
+// How the training and test samples are held in memory during training
+enum class FeatureStorage {
+    Diagram, // four wires per sample, products computed from line sums
+    Dense,   // one double per feature and sample
+    Uint8,   // one byte per feature and sample, widened on the fly
+    Float32  // one float per feature and sample
+};
 
 class MachineLearning {
 public:
     MachineLearning(const std::string& datasetPath);
-    void loadDataset();
-    void train(QProgressDialog& progressDialog);
+    // Returns false if no rows were loaded, e.g. because the file is missing or every row is malformed
+    bool loadDataset();
+    // Adds samples that are already in memory (e.g. from a MemorySink). Only the new rows are split between train
+    // and test; rows already in a split stay there.
+    void addSamples(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& labels);
+    // Updates the trained model with the training rows of the last addSamples instead of retraining on everything;
+    // its test rows are only scored
+    void partialTrain();
+    // Same with a batch from outside the dataset
+    void partialTrain(const std::vector<Diagram>& diagrams, const Eigen::VectorXd& labels);
+    bool isTrained() const { return model.isFitted(); }
+    const LogisticRegression& getModel() const { return model; }
+    // Grid search followed by a final fit. Blocks until done, so a GUI runs it on a BackgroundJob.
+    // Returns false if canceled or there are no training rows, in which case the previous model is kept.
+    bool train(const ProgressCallback& onProgress = nullptr, const CancellationToken* cancel = nullptr);
     double test(double lr, double reg, double thresh);
     int predict(const std::string& diagram);
+    // Batch scoring with the current model, in input order; false without a trained model
+    bool score(const std::vector<Diagram>& diagrams, ScoreSink& sink);
+    // Scores every diagram of a CSV and writes one "label,probability" line per input line to outputPath, with
+    // "Unscored," for blank and malformed lines; false without a trained model
+    bool scoreFile(const std::string& inputPath, const std::string& outputPath);
+
+    // Weights and test-set evaluation at each strength of a regularization path
+    struct RegularizationPath {
+        double learningRate;
+        std::vector<double> strengths; // strongest first
+        std::vector<size_t> slots;     // where each strength was in the strengths passed in
+        std::vector<Eigen::VectorXd> weights;
+        std::vector<double> biases;
+        std::vector<EvaluationReport> evaluations; // best threshold, accuracy, ROC/PR summary per strength
+        std::vector<Eigen::VectorXd> probabilities; // the evaluated rows' scores per strength
+        std::vector<LossHistory> histories;        // losses and iterations run per strength
+    };
+
+    // Fits every strength from strongest to weakest, each fit warm-started from the previous solution.
+    // Fits stop early on their training loss; the test set is only used for the evaluations.
+    // Safe to call concurrently; onIteration sees the iterations of every fit on the path.
+    RegularizationPath regularizationPath(double learningRate, std::vector<double> strengths,
+                                          const LogisticRegression::IterationCallback& onIteration = nullptr) const;
+    // Scores the test set once and sweeps every threshold over it
+    EvaluationReport evaluate() const;
+
+    // One configuration of the hyperparameter grid, scored on one or more validation splits
+    struct SearchResult {
+        double learningRate;
+        double regularization;
+        double threshold;    // one cutoff for every split: swept over the pooled validation scores of the folds, or
+                             // over the training rows when validating on the test split
+        double accuracy;     // mean over the splits, each at that shared cutoff
+        double accuracyStd;  // sample standard deviation over the splits; 0 for a single split
+        double rocAuc;       // mean
+        double iterations;   // mean iterations the fits ran before stopping
+    };
+
+    // k-fold cross-validation of every (learning rate, regularization) pair on the training split. The folds
+    // are index views of the one training design, and every (learning rate, fold) path runs on the pool.
+    std::vector<SearchResult> crossValidate(const std::vector<double>& learningRates, const std::vector<double>& regularizationModifiers,
+                                            int folds, const ProgressCallback& onProgress = nullptr,
+                                            const CancellationToken* cancel = nullptr, double progressShare = 1.0);
+
+    // The trained model with its hyperparameters, threshold and feature encoding; see modelfile.h.
+    // Loading a model switches to the encoding it was trained with.
+    bool saveModel(const std::string& modelPath) const;
+    bool loadModel(const std::string& modelPath);
+
+    // Defaults to FeatureStorage::Diagram
+    void setFeatureStorage(FeatureStorage storage);
+    // Features the next train runs on; changing it discards the trained model. Defaults to FeatureEncoding::Grid.
+    void setFeatureEncoding(FeatureEncoding encoding);
+    FeatureEncoding getFeatureEncoding() const { return featureEncoding; }
+    void setSolver(SolverType type);
+    // Folds used to select hyperparameters in train; below 2 selects on the test split instead, and the search fits
+    // then stop early on their training loss and take their threshold from the training rows. Defaults to 5.
+    void setCrossValidationFolds(int folds);
+    // Checks without improvement before a fit stops early: cross-validation fits watch their validation fold, the
+    // holdout search and the final fit their training loss. Improvement is totalled over the window, and for gradient
+    // descent and SGD the tolerance shrinks with the learning rate, so slow fits are not cut off while still
+    // descending. 0 runs every fit to its iteration budget. Defaults to 5.
+    void setEarlyStoppingPatience(int checks);
+    // Threads for parsing, the grid search, the full-batch products of the final fit and scoring; 0 means one per
+    // hardware thread, the default. Not to be called while train runs.
+    void setThreadCount(size_t threads);
 
 
 private:
     std::string path;
-    Eigen::MatrixXd X_train;
+    // Every sample is stored once; the train and test splits are index views of sampleDesign
+    std::vector<Diagram> sampleDiagrams;
+    Eigen::VectorXd sampleLabels;
+    Eigen::MatrixXd sampleFeatures; // only filled for FeatureStorage::Dense
+    std::vector<int> trainRows;
+    std::vector<int> testRows;
+    std::vector<int> addedTrainRows; // training rows of the last addSamples, until partialTrain uses them
     Eigen::VectorXd y_train;
-    Eigen::MatrixXd X_test;
     Eigen::VectorXd y_test;
+    FeatureStorage featureStorage;
+    FeatureEncoding featureEncoding;
+    SolverType solver;
+    int crossValidationFolds;
+    int earlyStoppingPatience;
+    std::unique_ptr<DesignMatrix> sampleDesign;
+    std::unique_ptr<DesignMatrix> trainDesign;
+    std::unique_ptr<DesignMatrix> testDesign;
     LogisticRegression model;
+    std::unique_ptr<ThreadPool> pool;
+
+    // Training and validation rows for one evaluation of the grid
+    struct Split {
+        const DesignMatrix* train;
+        const Eigen::VectorXd* trainLabels;
+        const DesignMatrix* validation;
+        const Eigen::VectorXd* validationLabels;
+        bool validationIsTest; // early stopping then watches the training loss and the threshold is swept over the
+                               // training rows, so neither weights nor cutoff are chosen on test rows
+    };
 
-    int encodeColor(const std::string& color);
-    std::pair<Eigen::VectorXd, int> processRow(const std::vector<std::string>& row);
-    void addIntercept(Eigen::MatrixXd& X);
-    void splitDataset(Eigen::MatrixXd& data, Eigen::VectorXd& labels);
+    void parseDataset(std::vector<Diagram>& temp_data, Eigen::VectorXd& labels);
+    void splitDataset();
+    void splitRows(size_t first);
+    void reportIncrementalAccuracy(size_t samples) const;
+    void buildDesigns();
+    void buildSplitViews();
+    std::vector<SearchResult> gridSearch(const std::vector<double>& learningRates, const std::vector<double>& regularizationModifiers,
+                                         const ProgressCallback& onProgress, const CancellationToken* cancel, double progressShare);
+    std::vector<SearchResult> searchSplits(const std::vector<Split>& splits, const std::vector<double>& learningRates,
+                                           const std::vector<double>& regularizationModifiers, const ProgressCallback& onProgress,
+                                           const CancellationToken* cancel, double progressShare);
+    RegularizationPath regularizationPath(double learningRate, std::vector<double> strengths, const Split& split,
+                                          const LogisticRegression::IterationCallback& onIteration) const;
     double evaluateAccuracy(const Eigen::VectorXd& predictions, const Eigen::VectorXd& actual) const;
     void playNotificationSound();
 
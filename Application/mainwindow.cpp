@@ -1,18 +1,23 @@
 #include "mainwindow.h"
 #include "startwidget.h"
-#include "DataGenerator.h"  // Include the DataGenerator header
+#include "datagenerator.h"  // Include the DataGenerator header
 #include "./ui_mainwindow.h"
 
 #include <iostream>
+#include <random>
+#include "threadpool.h"
+#include "diagramsink.h"
 #include <QFile>  // Include for QFile
 #include <QDir>  // Include for QDir
 
 #define DATASET_NAME "/diagrams.csv"
+#define MODEL_NAME "/model.bin"
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , ml((QCoreApplication::applicationDirPath()+DATASET_NAME).toStdString())
+    , trainingDialog(nullptr)
 {
     ui->setupUi(this);
     sound = new QSoundEffect(this);
@@ -31,6 +36,12 @@ MainWindow::MainWindow(QWidget *parent)
         ml.loadDataset();
         std::cout << "loaded dataset" << std::endl;
     }
+
+    // A model saved by an earlier run can predict right away, with or without a dataset
+    QString modelPath = QCoreApplication::applicationDirPath() + MODEL_NAME;
+    if (QFile::exists(modelPath) && ml.loadModel(modelPath.toStdString())) {
+        ui->startButton->show();
+    }
     connect(ui->startButton, &QPushButton::clicked, this, &MainWindow::onStartButtonClicked);
     connect(ui->trainButton, &QPushButton::clicked, this, &MainWindow::onTrainButtonClicked);
     connect(ui->generate, &QPushButton::clicked, this, &MainWindow::onGenerateDataSetClicked);
@@ -39,6 +50,9 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
+    // Stop a running training before ml goes away
+    trainingJob.cancel();
+    trainingJob.wait();
     delete ui;
     delete sound;
 }
@@ -51,19 +65,52 @@ void MainWindow::onStartButtonClicked()
 }
 
 void MainWindow::onTrainButtonClicked() {
-    QProgressDialog progressDialog("Training in progress...", "Cancel", 0, 100, this);
-    progressDialog.setWindowModality(Qt::WindowModal);
-    progressDialog.show();
+    trainingDialog = new QProgressDialog("Training in progress...", "Cancel", 0, 1000, this);
+    trainingDialog->setWindowModality(Qt::WindowModal);
+    trainingDialog->setAutoClose(false);
+    trainingDialog->setAutoReset(false);
+    connect(trainingDialog, &QProgressDialog::canceled, this, [this]() { trainingJob.cancel(); });
+    trainingDialog->show();
+
+    // ml is only touched by the job until it finishes
+    setButtonsEnabled(false);
+
+    // The job calls back on its own thread; both callbacks are queued to the GUI thread
+    trainingJob.start(
+        [this](const ProgressCallback& onProgress, const CancellationToken& cancel) {
+            return ml.train(onProgress, &cancel);
+        },
+        [this](double fraction) {
+            QMetaObject::invokeMethod(this, [this, fraction]() {
+                if (trainingDialog) {
+                    trainingDialog->setValue(static_cast<int>(fraction * 1000));
+                }
+            }, Qt::QueuedConnection);
+        },
+        [this](bool completed) {
+            QMetaObject::invokeMethod(this, [this, completed]() { onTrainingFinished(completed); }, Qt::QueuedConnection);
+        });
+}
+
+void MainWindow::onTrainingFinished(bool completed) {
+    trainingJob.wait();
+    trainingDialog->deleteLater();
+    trainingDialog = nullptr;
+    setButtonsEnabled(true);
 
-    // Call the updated training method with the progress dialog
-    ml.train(progressDialog);
+    if (completed) {
+        ml.saveModel((QCoreApplication::applicationDirPath() + MODEL_NAME).toStdString());
 
-    // Test the model
-//    ml.test();
+        // Hide button from view
+        ui->trainButton->hide();  // Hide the Train button
+        sound->play();
+    }
+}
 
-    // Hide button from view
-    ui->trainButton->hide();  // Hide the Train button
-    sound->play();
+void MainWindow::setButtonsEnabled(bool enabled) {
+    ui->startButton->setEnabled(enabled);
+    ui->trainButton->setEnabled(enabled);
+    ui->generate->setEnabled(enabled);
 }
 
 
@@ -80,19 +127,21 @@ void MainWindow::onGenerateDataSetClicked() {
     progressDialog.setValue(0);
 
 
-    DataGenerator generator;
-    for (int i = 0; i < number_of_diagrams; ++i) {
-        if (progressDialog.wasCanceled()) {
-            break; // Stop the loop if the user cancels the operation
-        }
-
-        generator.generateDiagram();
-        generator.saveToCSV("diagrams.csv");
+    // A fresh seed per run; logging it makes any generated dataset reproducible
+    uint32_t seed = std::random_device{}();
+    std::cout << "Generating with seed " << seed << std::endl;
 
+    // Rows go to diagrams.csv for the next start and straight into the training data for this session
+    CsvSink csv("diagrams.csv");
+    MemorySink memory;
+    TeeSink sink(csv, memory);
+    ThreadPool pool;
+    DataGenerator::generateBulk(number_of_diagrams, seed, pool, sink, [&](size_t generated) {
         // Update the progress dialog
-        progressDialog.setValue(i);
+        progressDialog.setValue(static_cast<int>(generated));
         QApplication::processEvents();
-    }
+        return !progressDialog.wasCanceled(); // Stop if the user cancels the operation
+    });
 
     // Update the progress dialog to complete
     progressDialog.setValue(number_of_diagrams);
@@ -100,7 +149,11 @@ void MainWindow::onGenerateDataSetClicked() {
     // Unhide the Start and Train buttons
     ui->startButton->show();
     ui->trainButton->show();
-    ml.loadDataset();
+    ml.addSamples(memory.diagrams(), memory.labels());
+    // A trained model learns from the new batch right away; a full retrain is still one click away
+    if (ml.isTrained()) {
+        ml.partialTrain();
+    }
     std::cout << "loaded dataset" << std::endl;
     std::cout << "BTW, you are only generating " << number_of_diagrams << " at a time" << std::endl;
 }
@@ -3,7 +3,9 @@
 
 #include <QMainWindow>
 #include <QSoundEffect>
+#include <QProgressDialog>
 #include "machinelearning.h"
+#include "backgroundjob.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -27,5 +29,10 @@ private:
     Ui::MainWindow *ui;
     QSoundEffect *sound;
     MachineLearning ml;
+    BackgroundJob trainingJob;          // runs ml.train off the GUI thread
+    QProgressDialog *trainingDialog;
+
+    void onTrainingFinished(bool completed);
+    void setButtonsEnabled(bool enabled);
 };
 #endif // MAINWINDOW_H
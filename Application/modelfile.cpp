@@ -0,0 +1,125 @@
+#include "modelfile.h"
+#include "diagram.h"
+#include "featureencoder.h"
+#include "mappedfile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+const char MODEL_MAGIC[8] = {'D', 'G', 'M', 'O', 'D', 'E', 'L', '1'};
+const uint32_t MODEL_VERSION = 3; // 2: the bias is a header field instead of weight 0; 3: the encoder is recorded
+
+struct ModelHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t featureEncodingVersion; // FEATURE_ENCODING_VERSION
+    uint32_t gridSize;
+    uint32_t featureCount;
+    uint32_t regularizationType;
+    uint32_t encoder; // FeatureEncoding
+    double learningRate;
+    double regularizationStrength;
+    double threshold;
+    double bias;
+};
+
+bool parseModel(const char* data, size_t size, LogisticRegression& model, FeatureEncoding& encoding, std::string& error) {
+    ModelHeader header;
+    if (size < sizeof(header)) {
+        error = "file too short";
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)) != 0 || header.version != MODEL_VERSION) {
+        error = "not a model file of version " + std::to_string(MODEL_VERSION);
+        return false;
+    }
+    if (header.encoder > static_cast<uint32_t>(FeatureEncoding::ColorOrder)) {
+        error = "unknown feature encoder " + std::to_string(header.encoder);
+        return false;
+    }
+    const FeatureEncoder& encoder = featureEncoder(static_cast<FeatureEncoding>(header.encoder));
+    if (header.featureEncodingVersion != FEATURE_ENCODING_VERSION || header.gridSize != GRID_SIZE || header.featureCount != encoder.featureCount()) {
+        error = "trained on feature encoding version " + std::to_string(header.featureEncodingVersion) + " with grid size "
+                + std::to_string(header.gridSize) + " and " + std::to_string(header.featureCount) + " " + encoder.name() + " features";
+        return false;
+    }
+    if (size != sizeof(header) + header.featureCount * sizeof(double) || header.regularizationType > 2) {
+        error = "corrupt model file";
+        return false;
+    }
+
+    Eigen::VectorXd weights(header.featureCount);
+    std::memcpy(weights.data(), data + sizeof(header), header.featureCount * sizeof(double));
+
+    model.setLearningRate(header.learningRate);
+    model.setRegularizationStrength(header.regularizationStrength);
+    model.setRegularizationType(static_cast<RegularizationType>(header.regularizationType));
+    model.setThreshold(header.threshold);
+    model.setWeights(weights, header.bias);
+    encoding = encoder.encoding();
+    return true;
+}
+
+}
+
+bool saveModel(const std::string& path, const LogisticRegression& model, FeatureEncoding encoding) {
+    Eigen::VectorXd weights = model.getWeights();
+
+    ModelHeader header = {};
+    std::memcpy(header.magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+    header.version = MODEL_VERSION;
+    header.featureEncodingVersion = FEATURE_ENCODING_VERSION;
+    header.gridSize = GRID_SIZE;
+    header.featureCount = static_cast<uint32_t>(weights.size());
+    header.regularizationType = static_cast<uint32_t>(model.getRegularizationType());
+    header.encoder = static_cast<uint32_t>(encoding);
+    header.learningRate = model.getLearningRate();
+    header.regularizationStrength = model.getRegularizationStrength();
+    header.threshold = model.getThreshold();
+    header.bias = model.getBias();
+
+    // Written through a temporary file, so an interrupted save never replaces a good model
+    std::string tempPath = path + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(weights.data()), weights.size() * sizeof(double));
+        file.close();
+        if (!file) {
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(tempPath, path, error);
+    if (error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool loadModel(const std::string& path, LogisticRegression& model, FeatureEncoding& encoding, std::string& error, bool useMapping) {
+    if (useMapping) {
+        MappedFile file(path);
+        if (!file.isOpen()) {
+            error = "could not open " + path;
+            return false;
+        }
+        return parseModel(file.data(), file.size(), model, encoding, error);
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "could not open " + path;
+        return false;
+    }
+    std::vector<char> contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return parseModel(contents.data(), contents.size(), model, encoding, error);
+}
@@ -0,0 +1,22 @@
+#ifndef MODELFILE_H
+#define MODELFILE_H
+
+#include <string>
+#include "logisticregression.h"
+#include "featureencoder.h"
+
+// Binary model file:
+//   header (magic, format version, feature encoding version, grid size, feature count, regularization type,
+//           encoder, learning rate, regularization strength, threshold, bias)
+//   featureCount weights as doubles.
+// A file is only loaded when its feature layout (encoding version, grid size, feature count of its encoder)
+// matches what this build computes, since weights for another layout would silently mean something else.
+
+bool saveModel(const std::string& path, const LogisticRegression& model, FeatureEncoding encoding);
+
+// Reads the file through a memory mapping or, with useMapping false, a plain stream, and sets encoding to
+// the encoder the model was trained with. Returns false and sets error if the file is missing, malformed
+// or was trained on another feature layout; model and encoding are left untouched in that case.
+bool loadModel(const std::string& path, LogisticRegression& model, FeatureEncoding& encoding, std::string& error, bool useMapping = true);
+
+#endif // MODELFILE_H
@@ -0,0 +1,110 @@
+// Model files: a saved model loads back unchanged through the mapping and the stream, damaged files or files of
+// another feature layout are rejected without touching the model, and a failed save leaves no temporary file.
+#include "modelfile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+namespace {
+
+#define HEADER_VERSION_OFFSET 8
+#define HEADER_ENCODING_VERSION_OFFSET 12
+#define HEADER_FEATURE_COUNT_OFFSET 20
+#define HEADER_REGULARIZATION_OFFSET 24
+#define HEADER_ENCODER_OFFSET 28
+
+bool check(bool condition, const std::string& name) {
+    std::cout << (condition ? "ok   " : "FAIL ") << name << std::endl;
+    return condition;
+}
+
+std::string readBytes(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void writeBytes(const std::string& path, const std::string& bytes) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+}
+
+void setField(std::string& bytes, size_t offset, uint32_t value) {
+    std::memcpy(&bytes[offset], &value, sizeof(value));
+}
+
+bool sameModel(const LogisticRegression& a, const LogisticRegression& b) {
+    return a.getWeights() == b.getWeights() && a.getBias() == b.getBias() && a.getThreshold() == b.getThreshold()
+           && a.getLearningRate() == b.getLearningRate() && a.getRegularizationStrength() == b.getRegularizationStrength()
+           && a.getRegularizationType() == b.getRegularizationType();
+}
+
+// Loads an edited copy of the good file, which must fail and leave the model as it was
+template <typename Edit>
+bool rejects(const std::string& good, const std::string& path, Edit edit) {
+    std::string bytes = good;
+    edit(bytes);
+    writeBytes(path, bytes);
+    LogisticRegression model(0.5, 1, 0.25);
+    FeatureEncoding encoding = FeatureEncoding::ColorOrder;
+    std::string error;
+    const bool rejected = !loadModel(path, model, encoding, error) && !error.empty();
+    return rejected && !model.isFitted() && model.getLearningRate() == 0.5 && encoding == FeatureEncoding::ColorOrder;
+}
+
+}
+
+int main() {
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "diagram-modelfiletest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string path = (directory / "model.bin").string();
+
+    const FeatureEncoder& encoder = featureEncoder(FeatureEncoding::WireSequence);
+    LogisticRegression saved(0.01, 100, 300.0, RegularizationType::L2);
+    saved.setWeights(Eigen::VectorXd::Random(encoder.featureCount()), -0.75);
+    saved.setThreshold(0.4375);
+
+    bool passed = check(saveModel(path, saved, encoder.encoding()), "save");
+    passed &= check(!std::filesystem::exists(path + ".tmp"), "no temporary file after a save");
+    for (bool useMapping : {true, false}) {
+        LogisticRegression loaded(0.0, 0, 0.0);
+        FeatureEncoding encoding = FeatureEncoding::Grid;
+        std::string error;
+        passed &= check(loadModel(path, loaded, encoding, error, useMapping) && sameModel(saved, loaded)
+                            && encoding == FeatureEncoding::WireSequence,
+                        useMapping ? "round trip through the mapping" : "round trip through the stream");
+    }
+
+    const std::string good = readBytes(path);
+    const std::string edited = (directory / "edited.bin").string();
+    passed &= check(rejects(good, edited, [](std::string& bytes) { bytes.resize(20); }), "short file rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { bytes.pop_back(); }), "truncated weights rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { bytes[0] = 'X'; }), "bad magic rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { ++bytes[HEADER_VERSION_OFFSET]; }), "other format version rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { setField(bytes, HEADER_ENCODING_VERSION_OFFSET, FEATURE_ENCODING_VERSION - 1); }),
+                    "other feature encoding version rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { setField(bytes, HEADER_ENCODER_OFFSET, 7); }), "unknown encoder rejected");
+    // The same weights claimed for the grid encoder no longer match its feature count
+    passed &= check(rejects(good, edited, [](std::string& bytes) { setField(bytes, HEADER_ENCODER_OFFSET, 0); }), "other encoder's layout rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { setField(bytes, HEADER_FEATURE_COUNT_OFFSET, 1u << 31); }),
+                    "bad feature count rejected");
+    passed &= check(rejects(good, edited, [](std::string& bytes) { setField(bytes, HEADER_REGULARIZATION_OFFSET, 9); }),
+                    "unknown regularization rejected");
+
+    LogisticRegression untouched(0.0, 0, 0.0);
+    FeatureEncoding encoding = FeatureEncoding::Grid;
+    std::string error;
+    passed &= check(!loadModel((directory / "missing.bin").string(), untouched, encoding, error) && !error.empty(), "missing file");
+
+    // A directory in the model's place makes the final rename fail
+    const std::string blocked = (directory / "blocked.bin").string();
+    std::filesystem::create_directories(std::filesystem::path(blocked) / "occupied");
+    passed &= check(!saveModel(blocked, saved, encoder.encoding()), "save over a directory fails");
+    passed &= check(!std::filesystem::exists(blocked + ".tmp"), "no temporary file after a failed save");
+
+    std::filesystem::remove_all(directory);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <functional>
+
+// Fraction of a long-running operation done so far, in [0, 1]. May be called from any thread.
+using ProgressCallback = std::function<void(double fraction)>;
+
+// Shared between whoever runs an operation and whoever may want to stop it. The operation polls
+// isCanceled() at its own safe points and returns early; nothing is interrupted forcibly.
+class CancellationToken {
+public:
+    void cancel() { canceled.store(true, std::memory_order_relaxed); }
+    void reset() { canceled.store(false, std::memory_order_relaxed); }
+    bool isCanceled() const { return canceled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> canceled{false};
+};
+
+#endif // PROGRESS_H
@@ -0,0 +1,66 @@
+// Row kernels of QuantizedDesign, built with AVX2 and FMA enabled (see CMakeLists.txt); only called once
+// quantizeddesign.cpp has checked the CPU. n is always a multiple of 16, the padded row stride.
+#include <immintrin.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+inline float horizontalSum(__m256 v) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// Widen 16 bytes to two vectors of 8 floats
+inline void widen(const uint8_t* x, __m256& lo, __m256& hi) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x));
+    lo = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+    hi = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+}
+
+}
+
+namespace quantizedavx2 {
+
+float dotRow(const uint8_t* x, const float* w, std::ptrdiff_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (std::ptrdiff_t j = 0; j < n; j += 16) {
+        __m256 lo, hi;
+        widen(x + j, lo, hi);
+        acc0 = _mm256_fmadd_ps(lo, _mm256_loadu_ps(w + j), acc0);
+        acc1 = _mm256_fmadd_ps(hi, _mm256_loadu_ps(w + j + 8), acc1);
+    }
+    return horizontalSum(_mm256_add_ps(acc0, acc1));
+}
+
+float dotRow(const float* x, const float* w, std::ptrdiff_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (std::ptrdiff_t j = 0; j < n; j += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j), _mm256_loadu_ps(w + j), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(x + j + 8), _mm256_loadu_ps(w + j + 8), acc1);
+    }
+    return horizontalSum(_mm256_add_ps(acc0, acc1));
+}
+
+void axpyRow(float a, const uint8_t* x, float* g, std::ptrdiff_t n) {
+    __m256 scale = _mm256_set1_ps(a);
+    for (std::ptrdiff_t j = 0; j < n; j += 16) {
+        __m256 lo, hi;
+        widen(x + j, lo, hi);
+        _mm256_storeu_ps(g + j, _mm256_fmadd_ps(scale, lo, _mm256_loadu_ps(g + j)));
+        _mm256_storeu_ps(g + j + 8, _mm256_fmadd_ps(scale, hi, _mm256_loadu_ps(g + j + 8)));
+    }
+}
+
+void axpyRow(float a, const float* x, float* g, std::ptrdiff_t n) {
+    __m256 scale = _mm256_set1_ps(a);
+    for (std::ptrdiff_t j = 0; j < n; j += 8) {
+        _mm256_storeu_ps(g + j, _mm256_fmadd_ps(scale, _mm256_loadu_ps(x + j), _mm256_loadu_ps(g + j)));
+    }
+}
+
+}
@@ -0,0 +1,175 @@
+#include "quantizeddesign.h"
+#include "cpufeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#ifdef HAVE_AVX2_KERNELS
+namespace quantizedavx2 {
+float dotRow(const uint8_t* x, const float* w, std::ptrdiff_t n);
+float dotRow(const float* x, const float* w, std::ptrdiff_t n);
+void axpyRow(float a, const uint8_t* x, float* g, std::ptrdiff_t n);
+void axpyRow(float a, const float* x, float* g, std::ptrdiff_t n);
+}
+#endif
+
+namespace {
+
+const Eigen::Index LANES = 32;      // row stride granularity, a multiple of every kernel's step
+const Eigen::Index ROW_BLOCK = 256; // rows accumulated in float before folding into the double result
+
+// Portable fallback; plain loops the compiler can auto-vectorize
+template <typename Cell>
+float scalarDotRow(const Cell* x, const float* w, std::ptrdiff_t n) {
+    float sum = 0.0f;
+    for (std::ptrdiff_t j = 0; j < n; ++j) {
+        sum += static_cast<float>(x[j]) * w[j];
+    }
+    return sum;
+}
+
+template <typename Cell>
+void scalarAxpyRow(float a, const Cell* x, float* g, std::ptrdiff_t n) {
+    for (std::ptrdiff_t j = 0; j < n; ++j) {
+        g[j] += a * static_cast<float>(x[j]);
+    }
+}
+
+// Row kernels for one cell type: the AVX2/FMA ones from quantizedavx2.cpp when the CPU has them, picked on first use
+template <typename Cell>
+struct RowKernels {
+    float (*dotRow)(const Cell*, const float*, std::ptrdiff_t) = scalarDotRow<Cell>;
+    void (*axpyRow)(float, const Cell*, float*, std::ptrdiff_t) = scalarAxpyRow<Cell>;
+};
+
+template <typename Cell>
+const RowKernels<Cell>& rowKernels() {
+    static const RowKernels<Cell> kernels = []() {
+        RowKernels<Cell> chosen;
+#ifdef HAVE_AVX2_KERNELS
+        if (cpuHasAvx2Fma()) {
+            chosen.dotRow = quantizedavx2::dotRow;
+            chosen.axpyRow = quantizedavx2::axpyRow;
+        }
+#endif
+        return chosen;
+    }();
+    return kernels;
+}
+
+}
+
+template <typename Cell>
+QuantizedDesign<Cell>::QuantizedDesign(Eigen::Index rows, Eigen::Index cols)
+    : rowCount(rows), colCount(cols), stride((cols + LANES - 1) / LANES * LANES), cells(rows * stride, Cell(0)) {}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::setRow(Eigen::Index i, const Eigen::VectorXd& features) {
+    Cell* out = cells.data() + i * stride;
+    for (Eigen::Index j = 0; j < colCount; ++j) {
+        if constexpr (std::is_integral_v<Cell>) {
+            out[j] = static_cast<Cell>(std::lround(features(j)));
+        } else {
+            out[j] = static_cast<Cell>(features(j));
+        }
+    }
+}
+
+template <typename Cell>
+template <typename RowIndex>
+void QuantizedDesign<Cell>::multiplyImpl(RowIndex rowAt, Eigen::Index count, const Eigen::VectorXd& w, double* z) const {
+    // Per-thread scratch, so repeated products do not allocate
+    thread_local std::vector<float> weights;
+    weights.assign(stride, 0.0f);
+    for (Eigen::Index j = 0; j < colCount; ++j) {
+        weights[j] = static_cast<float>(w(j));
+    }
+
+    const auto dotRow = rowKernels<Cell>().dotRow;
+    for (Eigen::Index i = 0; i < count; ++i) {
+        z[i] = dotRow(row(rowAt(i)), weights.data(), stride);
+    }
+}
+
+template <typename Cell>
+template <typename RowIndex>
+void QuantizedDesign<Cell>::transposeMultiplyImpl(RowIndex rowAt, Eigen::Index count, const double* r, Eigen::VectorXd& g) const {
+    thread_local std::vector<float> blockSum;
+    g.setZero(colCount);
+    const auto axpyRow = rowKernels<Cell>().axpyRow;
+
+    for (Eigen::Index start = 0; start < count; start += ROW_BLOCK) {
+        blockSum.assign(stride, 0.0f);
+        Eigen::Index end = std::min(count, start + ROW_BLOCK);
+        for (Eigen::Index i = start; i < end; ++i) {
+            axpyRow(static_cast<float>(r[i]), row(rowAt(i)), blockSum.data(), stride);
+        }
+        for (Eigen::Index j = 0; j < colCount; ++j) {
+            g(j) += blockSum[j];
+        }
+    }
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const {
+    z.resize(rowCount);
+    multiplyImpl([](Eigen::Index i) { return i; }, rowCount, w, z.data());
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const {
+    transposeMultiplyImpl([](Eigen::Index i) { return i; }, rowCount, r.data(), g);
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    multiplyImpl([rows](Eigen::Index i) { return static_cast<Eigen::Index>(rows[i]); }, count, w, z.data());
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    transposeMultiplyImpl([rows](Eigen::Index i) { return static_cast<Eigen::Index>(rows[i]); }, count, r.data(), g);
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const {
+    multiplyImpl([begin](Eigen::Index i) { return begin + i; }, count, w, z.data());
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const {
+    transposeMultiplyImpl([begin](Eigen::Index i) { return begin + i; }, count, r.data(), g);
+}
+
+template <typename Cell>
+template <typename RowIndex>
+void QuantizedDesign<Cell>::weightedGramImpl(RowIndex rowAt, Eigen::Index count, const double* s, Eigen::MatrixXd& H) const {
+    // Widen a block of rows at a time to double and let Eigen form the block's contribution
+    thread_local Eigen::MatrixXd block;
+    H.setZero(colCount, colCount);
+
+    for (Eigen::Index start = 0; start < count; start += ROW_BLOCK) {
+        Eigen::Index blockRows = std::min(ROW_BLOCK, count - start);
+        block.resize(blockRows, colCount);
+        for (Eigen::Index i = 0; i < blockRows; ++i) {
+            const Cell* cellsOfRow = row(rowAt(start + i));
+            for (Eigen::Index j = 0; j < colCount; ++j) {
+                block(i, j) = cellsOfRow[j];
+            }
+        }
+        H.noalias() += block.transpose() * Eigen::Map<const Eigen::VectorXd>(s + start, blockRows).asDiagonal() * block;
+    }
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const {
+    weightedGramImpl([](Eigen::Index i) { return i; }, rowCount, s.data(), H);
+}
+
+template <typename Cell>
+void QuantizedDesign<Cell>::weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const {
+    weightedGramImpl([rows](Eigen::Index i) { return static_cast<Eigen::Index>(rows[i]); }, count, s.data(), H);
+}
+
+template class QuantizedDesign<uint8_t>;
+template class QuantizedDesign<float>;
@@ -0,0 +1,45 @@
+#ifndef QUANTIZEDDESIGN_H
+#define QUANTIZEDDESIGN_H
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+#include "designmatrix.h"
+
+// Dense design matrix stored row-major in a narrow cell type (uint8_t or float) instead of double.
+// Products widen the cells to float on the fly and accumulate in float within blocks of rows, with the
+// block results summed in double. uint8_t holds every encoder's rows exactly since all features are 0-4.
+template <typename Cell>
+class QuantizedDesign : public DesignMatrix {
+public:
+    QuantizedDesign(Eigen::Index rows, Eigen::Index cols);
+
+    void setRow(Eigen::Index i, const Eigen::VectorXd& features);
+
+    Eigen::Index rows() const override { return rowCount; }
+    Eigen::Index cols() const override { return colCount; }
+    void multiply(const Eigen::VectorXd& w, Eigen::VectorXd& z) const override;
+    void transposeMultiply(const Eigen::VectorXd& r, Eigen::VectorXd& g) const override;
+    void multiplyRows(const int* rows, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void multiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::VectorXd& w, Eigen::Ref<Eigen::VectorXd> z) const override;
+    void transposeMultiplyRange(Eigen::Index begin, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& r, Eigen::VectorXd& g) const override;
+    void weightedGram(const Eigen::VectorXd& s, Eigen::MatrixXd& H) const override;
+    void weightedGramRows(const int* rows, Eigen::Index count, const Eigen::Ref<const Eigen::VectorXd>& s, Eigen::MatrixXd& H) const override;
+
+private:
+    Eigen::Index rowCount;
+    Eigen::Index colCount;
+    Eigen::Index stride; // colCount padded to a whole number of SIMD lanes; padding cells are zero
+    std::vector<Cell> cells;
+
+    const Cell* row(Eigen::Index i) const { return cells.data() + i * stride; }
+    template <typename RowIndex>
+    void multiplyImpl(RowIndex rowAt, Eigen::Index count, const Eigen::VectorXd& w, double* z) const;
+    template <typename RowIndex>
+    void transposeMultiplyImpl(RowIndex rowAt, Eigen::Index count, const double* r, Eigen::VectorXd& g) const;
+    template <typename RowIndex>
+    void weightedGramImpl(RowIndex rowAt, Eigen::Index count, const double* s, Eigen::MatrixXd& H) const;
+};
+
+#endif // QUANTIZEDDESIGN_H
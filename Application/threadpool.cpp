@@ -0,0 +1,85 @@
+#include "threadpool.h"
+
+namespace {
+
+thread_local const ThreadPool* currentPool = nullptr;
+
+}
+
+ThreadPool::ThreadPool(size_t threadCount) : stopping(false), batch(nullptr) {
+    if (threadCount == 0) {
+        threadCount = 1; // hardware_concurrency() may report 0 when unknown
+    }
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+bool ThreadPool::isWorkerThread() const {
+    return currentPool == this;
+}
+
+void ThreadPool::workerLoop() {
+    currentPool = this;
+    for (;;) {
+        std::function<void()> task;
+        Batch* joined = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto batchOpen = [this] { return batch && batch->next.load(std::memory_order_relaxed) < batch->count; };
+            condition.wait(lock, [&] { return stopping || !tasks.empty() || batchOpen(); });
+            if (batchOpen()) {
+                joined = batch;
+                ++joined->running;
+            } else if (stopping && tasks.empty()) {
+                return;
+            } else {
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+        }
+
+        if (joined) {
+            runIndices(*joined);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--joined->running == 0) {
+                batchDone.notify_all();
+            }
+            continue;
+        }
+        task();
+    }
+}
+
+void ThreadPool::runBatch(Batch& work) {
+    std::lock_guard<std::mutex> turn(batchTurn);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch = &work;
+    }
+    condition.notify_all();
+
+    // The caller works through the indices too, then waits for the workers still inside one
+    runIndices(work);
+    std::unique_lock<std::mutex> lock(mutex);
+    batchDone.wait(lock, [&work] { return work.running == 0; });
+    batch = nullptr;
+}
+
+void ThreadPool::runIndices(Batch& work) {
+    for (size_t index = work.next.fetch_add(1); index < work.count; index = work.next.fetch_add(1)) {
+        work.body(work.context, index);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed-size pool of worker threads fed from a single FIFO queue.
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+    // True on one of this pool's workers, where blocking on another task of the pool could deadlock
+    bool isWorkerThread() const;
+
+    template <typename F>
+    auto submit(F&& task) -> std::future<std::invoke_result_t<F>> {
+        using Result = std::invoke_result_t<F>;
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged]() { (*packaged)(); });
+        }
+        condition.notify_one();
+        return result;
+    }
+
+    // Runs body(i) for every i in [0, count) on the workers and the calling thread, and returns once all are done.
+    // Unlike submit it allocates nothing, so it suits loops that run every iteration of a fit. Calls from
+    // different threads take turns; do not call it from one of the pool's own workers.
+    template <typename F>
+    void forEachIndex(size_t count, F& body) {
+        Batch batch;
+        batch.body = [](void* context, size_t index) { (*static_cast<F*>(context))(index); };
+        batch.context = &body;
+        batch.count = count;
+        runBatch(batch);
+    }
+
+private:
+    struct Batch {
+        void (*body)(void*, size_t) = nullptr;
+        void* context = nullptr;
+        size_t count = 0;
+        std::atomic<size_t> next{0};
+        int running = 0; // workers inside the batch, guarded by mutex
+    };
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    Batch* batch;                       // guarded by mutex
+    std::mutex batchTurn;               // one forEachIndex at a time
+    std::condition_variable batchDone;
+
+    void workerLoop();
+    void runBatch(Batch& batch);
+    static void runIndices(Batch& batch);
+};
+
+#endif // THREADPOOL_H